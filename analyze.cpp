@@ -0,0 +1,408 @@
+/***********************************************************************
+ * Filename:   analyze.cpp
+ *
+ * Compile:    g++ analyze.cpp library.cpp difficulty.cpp -o analyze -pthread
+ * Run:        ./analyze [word-file] [index-file] [threads]
+ *             //defaults words.txt, words.idx, one thread per core
+ *
+ * Purpose:    Offline pass over the word bank. Plays every word against
+ *             a built-in solver to count the guesses it takes, scores
+ *             how rare its letters are, and writes both to the index
+ *             the server reads for READY TIER=easy|medium|hard.
+ ***********************************************************************/
+
+
+#include "library.h"
+#include "difficulty.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+using namespace std;
+
+//patterns as base-3 numbers: '_' 0, '?' 1, '+' 2; 3^MAX_WORD_LEN of them
+const uint32_t MAX_CODES = 6561;
+
+//the words of one length, packed, and the guesses each one needs
+struct LengthJob {
+    size_t        len;
+    size_t        count;
+    string        letters;      //count records of len letters
+    ScoreFn       score;
+    vector<float> guesses;
+};
+
+//per-thread scratch for scoring a guess against a set of words
+struct Scratch {
+    vector<uint32_t> counts;    //MAX_CODES zeros between uses
+    vector<uint32_t> codes;     //pattern of each word in the set
+};
+
+//a set of words the solver still can't tell apart, after depth guesses
+struct SolveTask {
+    LengthJob       *job;
+    vector<uint32_t> words;
+    int              depth;
+};
+
+
+
+/**********************************************************************
+ * Function: pattern_code
+ * Purpose:  Turn a feedback pattern into a number for bucketing.
+ *
+ * Parameters:
+ *   job    - const LengthJob&; the word list being solved.
+ *   guess  - uint32_t; index of the guessed word.
+ *   target - uint32_t; index of the hidden word.
+ *
+ * Returns:
+ *   uint32_t - the pattern as a base-3 number, below MAX_CODES.
+ *
+ **********************************************************************/
+uint32_t pattern_code(const LengthJob &job, uint32_t guess, uint32_t target) {
+    char pattern[MAX_WORD_LEN];
+    job.score(job.letters.data() + guess * job.len,
+              job.letters.data() + target * job.len, pattern);
+    uint32_t code = 0;
+    for (size_t i = 0; i < job.len; i++) {
+        code = code * 3 + (pattern[i] == '+' ? 2 : (pattern[i] == '?' ? 1 : 0));
+    }
+    return code;
+}
+
+
+
+/**********************************************************************
+ * Function: guess_cost
+ * Purpose:  How good a guess is against a set of possible words: the
+ *           sum of the squared sizes of the groups its feedback splits
+ *           them into, i.e. the set size times the expected number of
+ *           words left afterwards. Lower is better.
+ *
+ * Parameters:
+ *   job    - const LengthJob&; the word list being solved.
+ *   words  - const vector<uint32_t>&; words still possible.
+ *   guess  - uint32_t; index of the guess to try.
+ *   sc     - Scratch&; this thread's scratch space.
+ *
+ * Returns:
+ *   uint64_t - the cost.
+ *
+ **********************************************************************/
+uint64_t guess_cost(const LengthJob &job, const vector<uint32_t> &words, uint32_t guess,
+                    Scratch &sc) {
+    uint64_t cost = 0;
+    sc.codes.resize(words.size());
+    for (size_t i = 0; i < words.size(); i++) {
+        sc.codes[i] = pattern_code(job, guess, words[i]);
+        uint32_t &c = sc.counts[sc.codes[i]];
+        cost += 2 * (uint64_t)c + 1;    //(c + 1)^2 - c^2
+        c++;
+    }
+    for (size_t i = 0; i < words.size(); i++) {
+        sc.counts[sc.codes[i]] = 0;
+    }
+    return cost;
+}
+
+
+
+/**********************************************************************
+ * Function: best_guess
+ * Purpose:  The solver's choice: of the words still possible, the one
+ *           with the lowest guess_cost, the earliest on a tie.
+ *
+ * Parameters:
+ *   job    - const LengthJob&; the word list being solved.
+ *   words  - const vector<uint32_t>&; words still possible.
+ *   from   - size_t; first candidate position in words to try.
+ *   to     - size_t; one past the last.
+ *   sc     - Scratch&; this thread's scratch space.
+ *   cost   - uint64_t&; cost of the choice (output).
+ *
+ * Returns:
+ *   size_t - position in words of the choice.
+ *
+ **********************************************************************/
+size_t best_guess(const LengthJob &job, const vector<uint32_t> &words, size_t from, size_t to,
+                  Scratch &sc, uint64_t &cost) {
+    size_t best = from;
+    cost = UINT64_MAX;
+    for (size_t i = from; i < to; i++) {
+        uint64_t c = guess_cost(job, words, words[i], sc);
+        if (c < cost) {
+            cost = c;
+            best = i;
+        }
+    }
+    return best;
+}
+
+
+
+/**********************************************************************
+ * Function: split_after_guess
+ * Purpose:  Guess a word: the target it matches is solved, the rest
+ *           are grouped by the feedback they would have given.
+ *
+ * Parameters:
+ *   job    - LengthJob&; the word list being solved.
+ *   words  - const vector<uint32_t>&; words still possible.
+ *   guess  - uint32_t; the solver's guess.
+ *   depth  - int; guesses made before this one.
+ *   groups - vector<vector<uint32_t>>&; one group per pattern (output).
+ *
+ * Returns:
+ *   NULL
+ *
+ **********************************************************************/
+void split_after_guess(LengthJob &job, const vector<uint32_t> &words, uint32_t guess, int depth,
+                       vector<vector<uint32_t>> &groups) {
+    vector<pair<uint32_t, uint32_t>> coded;     //pattern, word
+    for (size_t i = 0; i < words.size(); i++) {
+        if (words[i] == guess) {
+            job.guesses[guess] = (float)(depth + 1);
+        } else {
+            coded.push_back(make_pair(pattern_code(job, guess, words[i]), words[i]));
+        }
+    }
+    sort(coded.begin(), coded.end());
+
+    groups.clear();
+    for (size_t i = 0; i < coded.size(); i++) {
+        if (i == 0 || coded[i].first != coded[i - 1].first) {
+            groups.push_back(vector<uint32_t>());
+        }
+        groups.back().push_back(coded[i].second);
+    }
+}
+
+
+
+/**********************************************************************
+ * Function: solve
+ * Purpose:  Play the solver against every word of a set at once,
+ *           recording the guesses each needs.
+ *
+ * Parameters:
+ *   job    - LengthJob&; the word list being solved.
+ *   words  - const vector<uint32_t>&; words still possible.
+ *   depth  - int; guesses made so far.
+ *   sc     - Scratch&; this thread's scratch space.
+ *
+ * Returns:
+ *   NULL
+ *
+ **********************************************************************/
+void solve(LengthJob &job, const vector<uint32_t> &words, int depth, Scratch &sc) {
+    uint64_t cost;
+    size_t pick = best_guess(job, words, 0, words.size(), sc, cost);
+
+    vector<vector<uint32_t>> groups;
+    split_after_guess(job, words, words[pick], depth, groups);
+    for (size_t i = 0; i < groups.size(); i++) {
+        solve(job, groups[i], depth + 1, sc);
+    }
+}
+
+
+
+/**********************************************************************
+ * Function: parallel_first_guess
+ * Purpose:  The first guess is the same for every word and costs the
+ *           most to find, so split the candidates across threads.
+ *
+ * Parameters:
+ *   job     - const LengthJob&; the word list being solved.
+ *   words   - const vector<uint32_t>&; every word of the length.
+ *   threads - int; threads to use.
+ *
+ * Returns:
+ *   uint32_t - the solver's first guess.
+ *
+ **********************************************************************/
+uint32_t parallel_first_guess(const LengthJob &job, const vector<uint32_t> &words, int threads) {
+    vector<uint64_t> costs(threads, UINT64_MAX);
+    vector<size_t>   picks(threads, 0);
+    vector<thread>   pool;
+    size_t per = (words.size() + threads - 1) / threads;
+    for (int t = 0; t < threads; t++) {
+        size_t from = min(words.size(), t * per);
+        size_t to   = min(words.size(), from + per);
+        pool.push_back(thread([&, t, from, to]() {
+            Scratch sc;
+            sc.counts.assign(MAX_CODES, 0);
+            if (from < to) {
+                picks[t] = best_guess(job, words, from, to, sc, costs[t]);
+            }
+        }));
+    }
+    for (size_t i = 0; i < pool.size(); i++) {
+        pool[i].join();
+    }
+
+    //ranges are in order, so the first strictly lower cost keeps the earliest word
+    int best = 0;
+    for (int t = 1; t < threads; t++) {
+        if (costs[t] < costs[best]) {
+            best = t;
+        }
+    }
+    return words[picks[best]];
+}
+
+
+
+/**********************************************************************
+ * Function: letter_rarity
+ * Purpose:  Mean bits of surprise per letter of each word, from how
+ *           often each letter appears among words of its length.
+ *
+ * Parameters:
+ *   job    - const LengthJob&; the word list.
+ *   rarity - vector<float>&; one value per word (output).
+ *
+ * Returns:
+ *   NULL
+ *
+ **********************************************************************/
+void letter_rarity(const LengthJob &job, vector<float> &rarity) {
+    double freq[26] = {0};
+    for (size_t i = 0; i < job.letters.size(); i++) {
+        freq[job.letters[i] - 'a'] += 1.0 / (double)job.letters.size();
+    }
+
+    rarity.assign(job.count, 0.0f);
+    for (size_t w = 0; w < job.count; w++) {
+        double bits = 0;
+        for (size_t i = 0; i < job.len; i++) {
+            bits -= log2(freq[job.letters[w * job.len + i] - 'a']);
+        }
+        rarity[w] = (float)(bits / (double)job.len);
+    }
+}
+
+
+
+
+
+int main(int argc, char *argv[]) {
+    if (argc > 4) {
+        cout << "Usage: " << argv[0] << " [word-file] [index-file] [threads]\n";
+        return 1;
+    }
+    string word_file  = argc >= 2 ? argv[1] : "words.txt";
+    string index_file = argc >= 3 ? argv[2] : "words.idx";
+    int threads = (int)thread::hardware_concurrency();
+    if (argc == 4) {
+        threads = atoi(argv[3]);
+    }
+    if (threads <= 0) {
+        threads = 1;
+    }
+
+    WordBank bank;
+    if (!load_word_bank(word_file, bank)) {
+        cout << "Could not load words from '" << word_file << "'.\n";
+        return 1;
+    }
+
+    //first guesses in parallel per length, then every group below them as a task
+    vector<LengthJob> jobs(MAX_WORD_LEN + 1);
+    vector<SolveTask> tasks;
+    for (size_t len = MIN_WORD_LEN; len <= MAX_WORD_LEN; len++) {
+        LengthJob &job = jobs[len];
+        job.len   = len;
+        job.count = bank.by_length[len].size();
+        job.score = get_scorer(len);
+        job.guesses.assign(job.count, 0.0f);
+        for (size_t i = 0; i < job.count; i++) {
+            job.letters += bank.by_length[len][i];
+        }
+        if (job.count == 0) {
+            continue;
+        }
+
+        vector<uint32_t> all(job.count);
+        for (size_t i = 0; i < job.count; i++) {
+            all[i] = (uint32_t)i;
+        }
+        uint32_t first = parallel_first_guess(job, all, threads);
+
+        vector<vector<uint32_t>> groups;
+        split_after_guess(job, all, first, 0, groups);
+        for (size_t i = 0; i < groups.size(); i++) {
+            SolveTask task;
+            task.job   = &job;
+            task.depth = 1;
+            task.words.swap(groups[i]);
+            tasks.push_back(task);
+        }
+    }
+
+    //biggest groups first so no thread is left with a large one at the end
+    sort(tasks.begin(), tasks.end(), [](const SolveTask &a, const SolveTask &b) {
+        return a.words.size() > b.words.size();
+    });
+    atomic<size_t> next_task(0);
+    vector<thread> pool;
+    for (int t = 0; t < threads; t++) {
+        pool.push_back(thread([&]() {
+            Scratch sc;
+            sc.counts.assign(MAX_CODES, 0);
+            size_t i;
+            while ((i = next_task.fetch_add(1)) < tasks.size()) {
+                solve(*tasks[i].job, tasks[i].words, tasks[i].depth, sc);
+            }
+        }));
+    }
+    for (size_t i = 0; i < pool.size(); i++) {
+        pool[i].join();
+    }
+
+    vector<WordScore> scores[MAX_WORD_LEN + 1];
+    for (size_t len = MIN_WORD_LEN; len <= MAX_WORD_LEN; len++) {
+        LengthJob &job = jobs[len];
+        if (job.count == 0) {
+            continue;
+        }
+        vector<float> rarity;
+        letter_rarity(job, rarity);
+
+        size_t easiest = 0, hardest = 0;
+        double total = 0;
+        for (size_t i = 0; i < job.count; i++) {
+            WordScore s;
+            s.guesses    = job.guesses[i];
+            s.rarity     = rarity[i];
+            s.difficulty = s.guesses + RARITY_WEIGHT * s.rarity;
+            scores[len].push_back(s);
+            total += s.guesses;
+            if (s.difficulty < scores[len][easiest].difficulty) {
+                easiest = i;
+            }
+            if (s.difficulty > scores[len][hardest].difficulty) {
+                hardest = i;
+            }
+        }
+        cout << len << " letters: " << job.count << " words, solver needs "
+             << total / (double)job.count << " guesses on average; easiest '"
+             << bank.by_length[len][easiest] << "', hardest '"
+             << bank.by_length[len][hardest] << "'.\n";
+    }
+
+    if (!write_difficulty_index(index_file, bank, scores)) {
+        cout << "Could not write '" << index_file << "'.\n";
+        return 1;
+    }
+    cout << "Wrote difficulty scores to " << index_file << " using "
+         << threads << " threads.\n";
+    return 0;
+}
@@ -11,7 +11,8 @@
  * Filename:   client.cpp
  *
  * Compile:    g++ client.cpp library.cpp -o client
- * Run:        ./client localhost [port]	//Defaul port is 5000
+ * Run:        ./client localhost [port] [length] [attempts] [hard]
+ *             //Defaults are port 5000, 5 letters, 6 attempts, normal
  *
  * Purpose:    Client Implementation
  ***********************************************************************/
@@ -33,7 +34,7 @@ using namespace std;
 
 //default port used when user doesn't specify one
 const int DEFAULT_PORT = 5000;
-const int MAX_ATTEMPTS = 6;
+const int DEFAULT_ATTEMPTS = 6;
 
 
 
@@ -122,25 +123,34 @@ int connect_to_server(const string &host, int port) {
  * Function: play_round
  * Purpose:  Play a single round with the server.
  *           Sends READY, receives the secret word, interacts with the
- *           user for up to MAX_ATTEMPTS guesses, and displays feedback.
+ *           user for up to max_attempts guesses, and displays feedback.
+ *           In hard mode guesses are scored by the server, which
+ *           refuses any guess that ignores earlier hints.
  *
  * Parameters:
- *   sockfd - int; connected socket descriptor to the server.
+ *   sockfd       - int; connected socket descriptor to the server.
+ *   word_len     - size_t; number of letters in the secret word.
+ *   max_attempts - int; number of guesses allowed.
+ *   hard         - bool; play in server-enforced hard mode.
  *
  * Returns:
  *   bool - true if the user chooses to play another round,
  *          false if the user chooses to quit or an error occurs.
  *
  **********************************************************************/
-bool play_round(int sockfd) {
+bool play_round(int sockfd, size_t word_len, int max_attempts, bool hard) {
 	//ANSI color codes
     const string GREEN  = "\033[42m\033[97m";
     const string YELLOW = "\033[43m\033[97m";
     const string GRAY   = "\033[100m\033[97m";
     const string RESET  = "\033[0m";
 	
-    //ask server for a new word
-    if (!send_message(sockfd, "READY")) {
+    //ask server for a new word; it ends the game after max_attempts guesses
+    string ready = "READY " + to_string(word_len) + " ATTEMPTS=" + to_string(max_attempts);
+    if (hard) {
+        ready += " HARD";
+    }
+    if (!send_message(sockfd, ready)) {
         cout << "Failed to send READY to server.\n";
         return false;
     }
@@ -153,18 +163,32 @@ bool play_round(int sockfd) {
     }
 
     secret = trim_whitespace(secret);
+    if (secret == "BYE") {
+        cout << "Server is shutting down. Please reconnect later.\n";
+        return false;
+    }
+    if (secret.compare(0, 5, "ERROR") == 0) {
+        cout << "Server error: " << trim_whitespace(secret.substr(5)) << ".\n";
+        return false;
+    }
     secret = to_lower_str(secret);
 
-    if (!validate_word(secret)) {
+    if (!validate_word(secret, word_len)) {
         cout << "Server sent invalid word: '" << secret << "'.\n";
         return false;
     }
 
+    //pick the kernel for this length once, reused for every guess
+    ScoreFn score = get_scorer(word_len);
+
     log_event("Client: received secret word from server.");
 
     cout << "\n=== New Round Started ===\n";
-    cout << "Guess the 5-letter word. You have "
-         << MAX_ATTEMPTS << " attempts.\n";	 
+    cout << "Guess the " << word_len << "-letter word. You have "
+         << max_attempts << " attempts.\n";	 
+    if (hard) {
+        cout << "Hard mode: every guess must use all hints so far.\n";
+    }
     cout << "------------------------------------------------------\n";
     cout << "Key: " << GREEN  << " A " << RESET << " = Correct Spot   "
 					<< YELLOW << " B " << RESET << " = Wrong Spot   "
@@ -174,8 +198,9 @@ bool play_round(int sockfd) {
     bool won     = false;
     int attempts = 0;
 
-    while (attempts < MAX_ATTEMPTS && !won) {
+    while (attempts < max_attempts && !won) {
         string guess;
+        char pattern[MAX_WORD_LEN];
 
         //get a valid guess
         while (true) {
@@ -188,21 +213,46 @@ bool play_round(int sockfd) {
             guess = trim_whitespace(guess);
             guess = to_lower_str(guess);
 
-            if (!validate_word(guess)) {
+            if (!validate_word(guess, word_len)) {
                 cout << "Invalid guess. Please enter exactly "
-                     << "5 alphabetic letters.\n";
+                     << word_len << " alphabetic letters.\n";
+                continue;
+            }
+
+            if (!hard) {
+                //use shared library to compare guess and word
+                score(guess.c_str(), secret.c_str(), pattern);
+                break;  //valid
+            }
+
+            //hard mode: the server scores it or says why not
+            string reply;
+            if (!send_message(sockfd, "GUESS " + guess) ||
+                !receive_message(sockfd, reply)) {
+                cout << "Lost connection to server.\n";
+                return false;
+            }
+            reply = trim_whitespace(reply);
+            if (reply.compare(0, 6, "REJECT") == 0) {
+                cout << "Not allowed: " << trim_whitespace(reply.substr(6)) << ".\n";
                 continue;
             }
+            if (reply.compare(0, 5, "ERROR") == 0) {
+                cout << "Server error: " << trim_whitespace(reply.substr(5)) << ".\n";
+                continue;
+            }
+            if (reply.size() != word_len) {
+                cout << "Server sent invalid feedback: '" << reply << "'.\n";
+                return false;
+            }
+            memcpy(pattern, reply.c_str(), word_len);
             break;  //valid
         }
 
         attempts++;
 
-        //use shared library to compare guess and word
-        string pattern = compare_guess(guess, secret);
-
         cout << "\n   "; 
-        for (int i = 0; i < 5; i++) {
+        for (size_t i = 0; i < word_len; i++) {
             if (pattern[i] == '+') {
                 //correct Spot (Green)
                 cout << GREEN << " " << (char)toupper(guess[i]) << " " << RESET;
@@ -220,7 +270,14 @@ bool play_round(int sockfd) {
             won = true;
         } else {
             cout << "Attempts remaining: "
-                 << (MAX_ATTEMPTS - attempts) << "\n";
+                 << (max_attempts - attempts) << "\n";
+
+            //hard mode also shows how many words still fit the hints
+            string remaining;
+            if (hard && send_message(sockfd, "REMAINING") &&
+                receive_message(sockfd, remaining)) {
+                cout << "Possible words left: " << trim_whitespace(remaining) << "\n";
+            }
         }
     }
 
@@ -258,16 +315,19 @@ bool play_round(int sockfd) {
 
 
 int main(int argc, char *argv[]) {
-    if (argc < 2 || argc > 3) {
+    if (argc < 2 || argc > 6) {
         cout << "Usage: " << argv[0]
-             << " <server-hostname> [port]\n";
+             << " <server-hostname> [port] [length] [attempts] [hard]\n";
         return 1;
     }
 
-    string host = argv[1];
-    int port    = DEFAULT_PORT;
+    string host      = argv[1];
+    int port         = DEFAULT_PORT;
+    size_t word_len  = DEFAULT_WORD_LEN;
+    int max_attempts = DEFAULT_ATTEMPTS;
+    bool hard        = false;
 
-    if (argc == 3) {
+    if (argc >= 3) {
         port = atoi(argv[2]);
         if (port <= 0 || port > 65535) {
             cout << "Invalid port number.\n";
@@ -275,6 +335,31 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    if (argc >= 4) {
+        word_len = (size_t)atoi(argv[3]);
+        if (!is_supported_length(word_len)) {
+            cout << "Word length must be between " << MIN_WORD_LEN
+                 << " and " << MAX_WORD_LEN << ".\n";
+            return 1;
+        }
+    }
+
+    if (argc >= 5) {
+        max_attempts = atoi(argv[4]);
+        if (max_attempts <= 0) {
+            cout << "Invalid number of attempts.\n";
+            return 1;
+        }
+    }
+
+    if (argc == 6) {
+        if (to_lower_str(argv[5]) != "hard") {
+            cout << "Last argument must be 'hard'.\n";
+            return 1;
+        }
+        hard = true;
+    }
+
     cout << "Connecting to " << host
          << " on port " << port << "...\n";
 
@@ -295,6 +380,12 @@ int main(int argc, char *argv[]) {
     }
 
     msg = trim_whitespace(msg);
+    if (msg.compare(0, 5, "ERROR") == 0 || msg.compare(0, 6, "REJECT") == 0) {
+        cout << "Server refused connection: "
+             << trim_whitespace(msg.substr(msg.find(' ') + 1)) << ".\n";
+        close_connection(sockfd);
+        return 1;
+    }
     if (msg != "HELLO") {
         cout << "Unexpected greeting from server: '"
              << msg << "'.\n";
@@ -307,7 +398,7 @@ int main(int argc, char *argv[]) {
     //Game loop: play rounds until user quits
     bool playMore = true;
     while (playMore) {
-        playMore = play_round(sockfd);
+        playMore = play_round(sockfd, word_len, max_attempts, hard);
     }
 
     //send BYE before closing connection
@@ -0,0 +1,179 @@
+/************************************************************/
+/* Filename: difficulty.cpp */
+/* Purpose: difficulty index file and per-tier alias tables for picking words. */
+/************************************************************/
+
+#include "difficulty.h"
+#include <algorithm>
+#include <fstream>
+#include <cstring>
+
+using namespace std;
+
+uint64_t bank_fingerprint(const WordBank &bank) {
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t len = 0; len <= MAX_WORD_LEN; len++) {
+        const vector<string> &words = bank.by_length[len];
+        for (size_t i = 0; i < words.size(); i++) {
+            for (size_t j = 0; j < words[i].size(); j++) {
+                h = (h ^ (uint8_t)words[i][j]) * 1099511628211ULL;
+            }
+            h = (h ^ '\n') * 1099511628211ULL;
+        }
+    }
+    return h;
+}
+
+bool write_difficulty_index(const string &path, const WordBank &bank,
+                            const vector<WordScore> *scores) {
+    ofstream fout(path.c_str(), ios::binary | ios::trunc);
+    if (!fout.is_open()) {
+        return false;
+    }
+
+    uint64_t print = bank_fingerprint(bank);
+    fout.write(DIFFICULTY_MAGIC, sizeof(DIFFICULTY_MAGIC));
+    fout.write((const char *)&print, sizeof(print));
+    for (size_t len = 0; len <= MAX_WORD_LEN; len++) {
+        uint32_t count = (uint32_t)scores[len].size();
+        fout.write((const char *)&count, sizeof(count));
+        fout.write((const char *)scores[len].data(), (streamsize)(count * sizeof(WordScore)));
+    }
+    return fout.good();
+}
+
+bool load_difficulty_index(const string &path, WordBank &bank) {
+    for (size_t len = 0; len <= MAX_WORD_LEN; len++) {
+        bank.difficulty[len].clear();
+    }
+
+    ifstream fin(path.c_str(), ios::binary);
+    if (!fin.is_open()) {
+        return false;
+    }
+
+    char magic[sizeof(DIFFICULTY_MAGIC)];
+    uint64_t print = 0;
+    fin.read(magic, sizeof(magic));
+    fin.read((char *)&print, sizeof(print));
+    if (!fin || memcmp(magic, DIFFICULTY_MAGIC, sizeof(magic)) != 0 ||
+        print != bank_fingerprint(bank)) {
+        return false;   //not an index, or one for a different word list
+    }
+
+    vector<float> loaded[MAX_WORD_LEN + 1];
+    for (size_t len = 0; len <= MAX_WORD_LEN; len++) {
+        uint32_t count = 0;
+        fin.read((char *)&count, sizeof(count));
+        if (!fin || count != bank.by_length[len].size()) {
+            return false;
+        }
+        vector<WordScore> scores(count);
+        fin.read((char *)scores.data(), (streamsize)(count * sizeof(WordScore)));
+        if (!fin) {
+            return false;
+        }
+        for (size_t i = 0; i < count; i++) {
+            loaded[len].push_back(scores[i].difficulty);
+        }
+    }
+
+    for (size_t len = 0; len <= MAX_WORD_LEN; len++) {
+        bank.difficulty[len].swap(loaded[len]);
+    }
+    return true;
+}
+
+int parse_tier(string_view name) {
+    if (name == "easy") {
+        return TIER_EASY;
+    }
+    if (name == "medium") {
+        return TIER_MEDIUM;
+    }
+    if (name == "hard") {
+        return TIER_HARD;
+    }
+    return -1;
+}
+
+// Thirds, rounded up at the two ends so they are never empty
+static void tier_range(size_t n, int tier, size_t &begin, size_t &end) {
+    size_t third = (n + 2) / 3;
+    if (tier == TIER_EASY) {
+        begin = 0;
+        end   = third;
+    } else if (tier == TIER_HARD) {
+        begin = n - third;
+        end   = n;
+    } else if (n > 2 * third) {
+        begin = third;
+        end   = n - third;
+    } else {
+        begin = 0;      //too few words for a middle third
+        end   = n;
+    }
+}
+
+size_t tier_size(size_t n, int tier) {
+    size_t begin, end;
+    tier_range(n, tier, begin, end);
+    return end - begin;
+}
+
+// Vose's method: pair each under-full column with an over-full one
+void build_tier_table(const vector<float> &difficulty, int tier, AliasEntry *out) {
+    size_t n = difficulty.size();
+    vector<uint32_t> order(n);
+    for (size_t i = 0; i < n; i++) {
+        order[i] = (uint32_t)i;
+    }
+    stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return difficulty[a] < difficulty[b];
+    });
+
+    size_t begin, end;
+    tier_range(n, tier, begin, end);
+    size_t m = end - begin;
+
+    //lean toward the tier's own end of the scale; every score is at least 1
+    vector<double> p(m);
+    double total = 0;
+    for (size_t i = 0; i < m; i++) {
+        double d = max(1.0, (double)difficulty[order[begin + i]]);
+        p[i]   = tier == TIER_EASY ? 1.0 / d : (tier == TIER_HARD ? d : 1.0);
+        total += p[i];
+    }
+
+    vector<size_t> small, large;
+    for (size_t i = 0; i < m; i++) {
+        p[i] = p[i] * (double)m / total;     //mean column is now exactly 1
+        out[i].word  = order[begin + i];
+        out[i].alias = order[begin + i];
+        (p[i] < 1.0 ? small : large).push_back(i);
+    }
+    while (!small.empty() && !large.empty()) {
+        size_t s = small.back();
+        size_t l = large.back();
+        small.pop_back();
+        large.pop_back();
+        out[s].alias     = order[begin + l];
+        out[s].threshold = (uint32_t)(p[s] * 4294967296.0);
+        p[l] = (p[l] + p[s]) - 1.0;
+        (p[l] < 1.0 ? small : large).push_back(l);
+    }
+    //whatever is left is full, up to rounding
+    for (size_t i = 0; i < large.size(); i++) {
+        out[large[i]].threshold = UINT32_MAX;
+    }
+    for (size_t i = 0; i < small.size(); i++) {
+        out[small[i]].threshold = UINT32_MAX;
+        out[small[i]].alias     = out[small[i]].word;
+    }
+}
+
+uint32_t sample_alias(const AliasEntry *table, size_t n, uint64_t &rng) {
+    uint64_t r = next_random(rng);
+    const AliasEntry &col = table[((r >> 32) * n) >> 32];
+    return (uint32_t)r < col.threshold ? col.word : col.alias;
+}
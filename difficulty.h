@@ -0,0 +1,140 @@
+#ifndef DIFFICULTY_H
+#define DIFFICULTY_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "library.h"
+using namespace std;
+
+//difficulty tiers a game can ask for; each holds about a third of the words
+const int TIER_EASY   = 0;
+const int TIER_MEDIUM = 1;
+const int TIER_HARD   = 2;
+const int NUM_TIERS   = 3;
+
+//sidecar index file layout: DIFFICULTY_MAGIC, the bank's fingerprint
+//(uint64_t), then for each length 0..MAX_WORD_LEN a uint32_t count and that
+//many WordScore records, in the same order as the words in the bank
+const char DIFFICULTY_MAGIC[8] = {'W', 'R', 'D', 'L', 'I', 'D', 'X', '1'};
+
+//how much one bit of letter rarity adds to a word's difficulty, in guesses
+const float RARITY_WEIGHT = 0.25f;
+
+//scores for one word, written by ./analyze
+struct WordScore {
+    float guesses;      //guesses the built-in solver needs for this word
+    float rarity;       //mean bits of surprise per letter
+    float difficulty;   //guesses + RARITY_WEIGHT * rarity
+};
+
+//one column of a Walker/Vose alias table: pick a column at random, then
+//word if the low 32 random bits are below threshold, alias otherwise
+struct AliasEntry {
+    uint32_t word;      //index into the bank's words of this length
+    uint32_t alias;
+    uint32_t threshold; //probability of word, scaled to 2^32
+};
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  bank_fingerprint                                    */
+/* Description:    FNV-1a hash over every word of a bank in order, so  */
+/*                 an index built for another word list is noticed.    */
+/* Parameters:     const WordBank &bank: words to hash – input         */
+/* Return Value:   uint64_t – the fingerprint                          */
+/*                                                                     */
+/***********************************************************************/
+
+uint64_t bank_fingerprint(const WordBank &bank);
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  write_difficulty_index                              */
+/* Description:    Writes the scores of every word to a sidecar index  */
+/*                 file.                                               */
+/* Parameters:     const string &path: index file – input              */
+/*                 const WordBank &bank: the scored bank – input       */
+/*                 const vector<WordScore> *scores: MAX_WORD_LEN + 1   */
+/*                 lists, one per length, matching bank – input        */
+/* Return Value:   bool – false if the file could not be written       */
+/*                                                                     */
+/***********************************************************************/
+
+bool write_difficulty_index(const string &path, const WordBank &bank,
+                            const vector<WordScore> *scores);
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  load_difficulty_index                               */
+/* Description:    Reads a sidecar index into bank.difficulty. Leaves  */
+/*                 the bank without difficulty if the file is missing, */
+/*                 damaged or was built from a different word list.    */
+/* Parameters:     const string &path: index file – input              */
+/*                 WordBank &bank: bank loaded from the word file –    */
+/*                 input/output                                        */
+/* Return Value:   bool – true if the scores were loaded               */
+/*                                                                     */
+/***********************************************************************/
+
+bool load_difficulty_index(const string &path, WordBank &bank);
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  parse_tier                                          */
+/* Description:    Reads a tier name as sent in READY's TIER=<name>.   */
+/* Parameters:     string_view name: "easy", "medium" or "hard" –      */
+/*                 input                                               */
+/* Return Value:   int – TIER_EASY, TIER_MEDIUM, TIER_HARD, or -1      */
+/*                                                                     */
+/***********************************************************************/
+
+int parse_tier(string_view name);
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  tier_size                                           */
+/* Description:    Number of words in one tier of a list of n words.   */
+/*                 The easy and hard thirds are never empty while      */
+/*                 n > 0; with too few words for a middle third,       */
+/*                 medium is the whole list.                           */
+/* Parameters:     size_t n: words of one length – input               */
+/*                 int tier: TIER_* – input                            */
+/* Return Value:   size_t – words in the tier                          */
+/*                                                                     */
+/***********************************************************************/
+
+size_t tier_size(size_t n, int tier);
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  build_tier_table                                    */
+/* Description:    Builds the alias table for one tier: the tier's     */
+/*                 words by difficulty, weighted toward the easy end   */
+/*                 for easy, the hard end for hard, evenly for medium. */
+/* Parameters:     const vector<float> &difficulty: per word – input   */
+/*                 int tier: TIER_* – input                            */
+/*                 AliasEntry *out: tier_size() entries – output       */
+/* Return Value:   void – no return value                              */
+/*                                                                     */
+/***********************************************************************/
+
+void build_tier_table(const vector<float> &difficulty, int tier, AliasEntry *out);
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  sample_alias                                        */
+/* Description:    Picks one word from an alias table in O(1): one     */
+/*                 random number, one column, one comparison.          */
+/* Parameters:     const AliasEntry *table: the tier's table – input   */
+/*                 size_t n: entries in table, > 0 – input             */
+/*                 uint64_t &rng: next_random() state – input/output   */
+/* Return Value:   uint32_t – index of the word in its length's list   */
+/*                                                                     */
+/***********************************************************************/
+
+uint32_t sample_alias(const AliasEntry *table, size_t n, uint64_t &rng);
+
+#endif
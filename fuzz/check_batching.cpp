@@ -0,0 +1,188 @@
+/***********************************************************************
+ * Filename:   check_batching.cpp
+ *
+ * Compile:    g++ -O2 -pthread fuzz/check_batching.cpp library.cpp game.cpp shared.cpp \
+ *                 trace.cpp ratelimit.cpp difficulty.cpp profile.cpp -o check_batching
+ * Run:        ./check_batching
+ *
+ * Purpose:    Checks reply batching in the server's own handle_client.
+ *             The client side is a SOCK_SEQPACKET socketpair, so every
+ *             command the client writes arrives in a read of its own
+ *             and every write the server makes arrives as one record
+ *             that can be counted. Pipelined commands must take fewer
+ *             writes with --flush-us than without it, and a client
+ *             that waits for each reply must still get it within
+ *             --flush-us. Exits 1 if any check fails. Needs no
+ *             network.
+ ***********************************************************************/
+
+
+//the server's code, with its main() renamed so this file can supply one
+#define main server_main
+#include "../server.cpp"
+#undef main
+
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+const char *const CHECK_WORDS[] = { "crane", "geese", "llama", "ocean" };
+
+//what a pipelining client sends, one write per command
+const char *const PIPELINE[] = { "READY 5", "GUESS geese", "GUESS llama", "REMAINING", "BYE" };
+const size_t PIPELINE_LEN = sizeof(PIPELINE) / sizeof(PIPELINE[0]);
+
+//long enough that a loaded machine still batches the whole pipeline
+const uint64_t BATCH_FLUSH_US = 200000;
+
+//lockstep deadline, and how late past it a reply may still count as on time
+const uint64_t LOCKSTEP_FLUSH_US = 20000;
+const uint64_t LOCKSTEP_SLACK_US = 500000;
+
+WorkerStats   *g_check_stats = nullptr;
+ClientSession  g_check_session;
+
+
+
+/**********************************************************************
+ * Function: count_writes
+ * Purpose:  Serve one connection whose client writes the whole
+ *           pipeline up front, and count the server's writes.
+ *
+ * Parameters:
+ *   flush_us - uint64_t; --flush-us for this connection.
+ *   replies  - size_t&; reply lines received, HELLO included (output).
+ *
+ * Returns:
+ *   int - how many writes the replies took, or -1 if the socketpair
+ *         could not be made.
+ *
+ **********************************************************************/
+int count_writes(uint64_t flush_us, size_t &replies) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) == -1) {
+        perror("socketpair");
+        return -1;
+    }
+    for (size_t i = 0; i < PIPELINE_LEN; i++) {
+        string line = string(PIPELINE[i]) + "\n";
+        if (write(fds[1], line.data(), line.size()) != (ssize_t)line.size()) {
+            perror("write");
+        }
+    }
+
+    //read while the server writes, so neither side blocks
+    int writes = 0;
+    replies = 0;
+    thread reader([&]() {
+        char buf[REPLY_BUFF_SIZE];
+        ssize_t n;
+        while ((n = recv(fds[1], buf, sizeof(buf), 0)) > 0) {
+            writes++;
+            replies += (size_t)count(buf, buf + n, '\n');
+        }
+    });
+
+    g_flush_us = flush_us;
+    handle_client(fds[0], g_shm, g_check_stats, 0, &g_check_session);
+    reader.join();
+    close(fds[1]);
+    return writes;
+}
+
+/**********************************************************************
+ * Function: lockstep_wait_us
+ * Purpose:  Act as a client that sends one command and waits for its
+ *           reply, and time the wait.
+ *
+ * Parameters:
+ *   flush_us - uint64_t; --flush-us for this connection.
+ *
+ * Returns:
+ *   int64_t - microseconds from sending READY to its reply, or -1 if
+ *             no reply came.
+ *
+ **********************************************************************/
+int64_t lockstep_wait_us(uint64_t flush_us) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) == -1) {
+        perror("socketpair");
+        return -1;
+    }
+
+    int64_t waited = -1;
+    thread client([&]() {
+        char buf[REPLY_BUFF_SIZE];
+        if (recv(fds[1], buf, sizeof(buf), 0) <= 0) {      //HELLO
+            return;
+        }
+        auto start = chrono::steady_clock::now();
+        if (write(fds[1], "READY 5\n", 8) != 8 || recv(fds[1], buf, sizeof(buf), 0) <= 0) {
+            return;
+        }
+        waited = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start)
+                     .count();
+        if (write(fds[1], "BYE\n", 4) == 4) {
+            while (recv(fds[1], buf, sizeof(buf), 0) > 0) {
+            }
+        }
+    });
+
+    g_flush_us = flush_us;
+    handle_client(fds[0], g_shm, g_check_stats, 0, &g_check_session);
+    client.join();
+    close(fds[1]);
+    return waited;
+}
+
+int main() {
+    WordBank bank;
+    for (size_t i = 0; i < sizeof(CHECK_WORDS) / sizeof(CHECK_WORDS[0]); i++) {
+        bank.by_length[5].push_back(CHECK_WORDS[i]);
+    }
+    g_shm = create_shared_segment(bank);
+    if (g_shm == nullptr) {
+        return 1;
+    }
+    init_rate_table(g_shm->limits, 0, 0);
+    g_check_stats = claim_worker_stats(g_shm, getpid());
+    g_seeded = true;
+    g_seed   = 1;
+
+    //no per-command chatter
+    cout.setstate(ios::failbit);
+    signal(SIGPIPE, SIG_IGN);
+
+    int failures = 0;
+
+    //HELLO, then one write per reply; BYE gets none
+    size_t lines_each = 0, lines_batched = 0;
+    int each    = count_writes(0, lines_each);
+    int batched = count_writes(BATCH_FLUSH_US, lines_batched);
+    cerr << "pipeline of " << PIPELINE_LEN << " commands: " << each
+         << " writes with --flush-us 0, " << batched << " with --flush-us "
+         << BATCH_FLUSH_US << endl;
+    if (each != (int)PIPELINE_LEN || lines_each != PIPELINE_LEN) {
+        cerr << "FAIL: expected one write per reply without batching" << endl;
+        failures++;
+    }
+    //HELLO goes out at once; every reply after it in one write
+    if (batched != 2 || lines_batched != lines_each) {
+        cerr << "FAIL: expected the pipeline's replies in one write" << endl;
+        failures++;
+    }
+
+    int64_t waited = lockstep_wait_us(LOCKSTEP_FLUSH_US);
+    cerr << "lockstep reply after " << waited << "us with --flush-us "
+         << LOCKSTEP_FLUSH_US << endl;
+    if (waited < 0 || (uint64_t)waited > LOCKSTEP_FLUSH_US + LOCKSTEP_SLACK_US) {
+        cerr << "FAIL: a waiting client's reply was held past --flush-us" << endl;
+        failures++;
+    }
+
+    if (failures > 0) {
+        return 1;
+    }
+    cerr << "All batching checks passed." << endl;
+    return 0;
+}
@@ -0,0 +1,385 @@
+/***********************************************************************
+ * Filename:   check_scorer.cpp
+ *
+ * Compile:    g++ -O2 fuzz/check_scorer.cpp library.cpp game.cpp -o check_scorer
+ * Run:        ./check_scorer [words] [seed] [stride]
+ *             //stride N checks every Nth of the 26^5 guesses (default 1,
+ *             //all of them); seed changes the random samples
+ *
+ * Purpose:    Property tests for the scoring path. Checks the
+ *             length-specialized kernels, compare_guess and the hard
+ *             mode / candidate tracking in game.cpp against a plain
+ *             nested-loop reference scorer: every 5-letter guess
+ *             against every 5-letter target, random samples for the
+ *             other lengths, and whole games over the word list.
+ *             Prints the first mismatches and exits 1 if any check
+ *             fails. Needs no network.
+ ***********************************************************************/
+
+
+#include "../library.h"
+#include "../game.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+
+const string WORD_FILE = "words.txt";
+
+//mismatches printed per check; the rest are only counted
+const int MAX_REPORTS = 5;
+
+//random guess/target pairs per length
+const int RANDOM_PAIRS = 200000;
+
+//games played per length, and guesses per game
+const int GAMES_PER_LENGTH = 200;
+const int GUESSES_PER_GAME = 6;
+
+//5-letter targets with repeated letters, the cases most likely to go
+//wrong, checked against every guess along with the word list
+const char *const REPEAT_TARGETS[] = {"aaaaa", "abbey", "geese", "llama", "mamma", "sissy"};
+
+//failures over all checks
+int g_failures = 0;
+
+
+
+/**********************************************************************
+ * Function: reference_score
+ * Purpose:  Score a guess the slow, obvious way: mark exact matches,
+ *           then for each other guess letter take the first unused
+ *           matching target letter. This is the original
+ *           compare_guess, for any length.
+ *
+ * Parameters:
+ *   guess  - const char*; len letters.
+ *   target - const char*; len letters, the word being guessed.
+ *   len    - size_t; word length, at most MAX_WORD_LEN.
+ *   out    - char*; one '+', '?' or '_' per letter (output).
+ *
+ * Returns:
+ *   NULL
+ *
+ **********************************************************************/
+void reference_score(const char *guess, const char *target, size_t len, char *out) {
+    char lower[MAX_WORD_LEN];
+    char temp[MAX_WORD_LEN];
+    for (size_t i = 0; i < len; i++) {
+        lower[i] = (char)tolower((unsigned char)guess[i]);
+        temp[i]  = (char)tolower((unsigned char)target[i]);
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        out[i] = '_';
+        if (lower[i] == temp[i]) {
+            out[i]  = '+';
+            temp[i] = '*';
+        }
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        if (out[i] == '+') {
+            continue;
+        }
+        for (size_t j = 0; j < len; j++) {
+            if (temp[j] != '*' && lower[i] == temp[j]) {
+                out[i]  = '?';
+                temp[j] = '*';
+                break;
+            }
+        }
+    }
+}
+
+// Same, as a string
+string reference_score(string_view guess, string_view target) {
+    string result(target.size(), '_');
+    reference_score(guess.data(), target.data(), target.size(), &result[0]);
+    return result;
+}
+
+/**********************************************************************
+ * Function: report
+ * Purpose:  Count one failed check, printing the first few.
+ *
+ * Parameters:
+ *   count  - int&; failures of this check so far (input/output).
+ *   what   - const string&; which check failed.
+ *   detail - const string&; the inputs and the two answers.
+ *
+ * Returns:
+ *   NULL
+ *
+ **********************************************************************/
+void report(int &count, const string &what, const string &detail) {
+    if (count < MAX_REPORTS) {
+        cout << "  FAIL " << what << ": " << detail << endl;
+    }
+    count++;
+    g_failures++;
+}
+
+/**********************************************************************
+ * Function: check_kernel
+ * Purpose:  Compare the kernel for target's length with the reference
+ *           on one pair, without allocating unless they differ.
+ *
+ * Parameters:
+ *   score  - ScoreFn; the kernel from get_scorer(target.size()).
+ *   guess  - string_view; the guess, same length as target.
+ *   target - string_view; the target.
+ *   count  - int&; failures of this check so far (input/output).
+ *
+ * Returns:
+ *   NULL
+ *
+ **********************************************************************/
+void check_kernel(ScoreFn score, string_view guess, string_view target, int &count) {
+    char want[MAX_WORD_LEN];
+    char got[MAX_WORD_LEN];
+    size_t len = target.size();
+    reference_score(guess.data(), target.data(), len, want);
+    score(guess.data(), target.data(), got);
+    if (memcmp(got, want, len) != 0) {
+        report(count, "score_guess_n<" + to_string(len) + ">",
+               string(guess) + " vs " + string(target) + " gave " +
+               string(got, len) + ", want " + string(want, len));
+    }
+}
+
+/**********************************************************************
+ * Function: random_word
+ * Purpose:  Make a random word of mixed-case letters. Half the time
+ *           the letters come from a 3-letter alphabet, so repeats are
+ *           common.
+ *
+ * Parameters:
+ *   len - size_t; letters to make.
+ *   rng - uint64_t&; random state (input/output).
+ *
+ * Returns:
+ *   string - the word.
+ *
+ **********************************************************************/
+string random_word(size_t len, uint64_t &rng) {
+    int alphabet = next_random(rng) % 2 == 0 ? 3 : 26;
+    string w(len, 'a');
+    for (size_t i = 0; i < len; i++) {
+        uint64_t r = next_random(rng);
+        w[i] = (char)('a' + r % alphabet);
+        if ((r >> 32) % 4 == 0) {
+            w[i] = (char)(w[i] - 'a' + 'A');
+        }
+    }
+    return w;
+}
+
+/**********************************************************************
+ * Function: check_all_guesses
+ * Purpose:  Every lowercase 5-letter guess (every stride-th one)
+ *           against every 5-letter word in the list and the
+ *           repeated-letter targets.
+ *
+ * Parameters:
+ *   bank   - const WordBank&; the word list.
+ *   stride - uint64_t; check every stride-th guess.
+ *
+ * Returns:
+ *   NULL
+ *
+ **********************************************************************/
+void check_all_guesses(const WordBank &bank, uint64_t stride) {
+    vector<string> targets = bank.by_length[5];
+    for (size_t i = 0; i < sizeof(REPEAT_TARGETS) / sizeof(REPEAT_TARGETS[0]); i++) {
+        targets.push_back(REPEAT_TARGETS[i]);
+    }
+
+    ScoreFn score = get_scorer(5);
+    int count = 0;
+    uint64_t checked = 0;
+    uint64_t total = 26ULL * 26 * 26 * 26 * 26;
+    char guess[5];
+    for (uint64_t n = 0; n < total; n += stride) {
+        uint64_t v = n;
+        for (int i = 4; i >= 0; i--) {
+            guess[i] = (char)('a' + v % 26);
+            v /= 26;
+        }
+        for (size_t t = 0; t < targets.size(); t++) {
+            check_kernel(score, string_view(guess, 5), targets[t], count);
+            checked++;
+        }
+    }
+    cout << (count == 0 ? "ok  " : "FAIL") << " all 5-letter guesses: " << checked
+         << " pairs over " << targets.size() << " targets" << endl;
+}
+
+/**********************************************************************
+ * Function: check_random_pairs
+ * Purpose:  Random mixed-case pairs at every supported length, half
+ *           with a target from the word list, through both the kernel
+ *           and compare_guess, plus compare_guess on mismatched and
+ *           unsupported lengths.
+ *
+ * Parameters:
+ *   bank - const WordBank&; the word list.
+ *   rng  - uint64_t&; random state (input/output).
+ *
+ * Returns:
+ *   NULL
+ *
+ **********************************************************************/
+void check_random_pairs(const WordBank &bank, uint64_t &rng) {
+    int count = 0;
+    for (size_t len = MIN_WORD_LEN; len <= MAX_WORD_LEN; len++) {
+        const vector<string> &words = bank.by_length[len];
+        ScoreFn score = get_scorer(len);
+        for (int i = 0; i < RANDOM_PAIRS; i++) {
+            string guess  = random_word(len, rng);
+            string target = random_word(len, rng);
+            if (!words.empty() && i % 2 == 0) {
+                target = words[next_random(rng) % words.size()];
+            }
+            check_kernel(score, guess, target, count);
+
+            string want = reference_score(guess, target);
+            string got  = compare_guess(guess, target);
+            if (got != want) {
+                report(count, "compare_guess", guess + " vs " + target + " gave " + got +
+                       ", want " + want);
+            }
+        }
+    }
+
+    //nothing matches when the lengths differ or no kernel exists
+    const char *const odd[][2] = {{"crane", "cranes"}, {"cranes", "crane"}, {"abc", "abc"},
+                                  {"abcdefghi", "abcdefghi"}, {"", ""}};
+    for (size_t i = 0; i < sizeof(odd) / sizeof(odd[0]); i++) {
+        string got = compare_guess(odd[i][0], odd[i][1]);
+        if (got != string(strlen(odd[i][1]), '_')) {
+            report(count, "compare_guess length", string(odd[i][0]) + " vs " + odd[i][1] +
+                   " gave " + got);
+        }
+    }
+    cout << (count == 0 ? "ok  " : "FAIL") << " random pairs: " << RANDOM_PAIRS
+         << " per length " << MIN_WORD_LEN << "-" << MAX_WORD_LEN << endl;
+}
+
+/**********************************************************************
+ * Function: check_games
+ * Purpose:  Play random hard mode games with play_guess and check,
+ *           after every guess, the pattern, the refusal of guesses
+ *           that break earlier hints, and that the remaining count is
+ *           exactly the words the reference says are still possible.
+ *
+ * Parameters:
+ *   bank - const WordBank&; the word list.
+ *   rng  - uint64_t&; random state (input/output).
+ *
+ * Returns:
+ *   NULL
+ *
+ **********************************************************************/
+void check_games(const WordBank &bank, uint64_t &rng) {
+    int count = 0;
+    int games = 0;
+    GameSession game;
+    for (size_t len = MIN_WORD_LEN; len <= MAX_WORD_LEN; len++) {
+        const vector<string> &words = bank.by_length[len];
+        if (words.empty()) {
+            continue;
+        }
+        string packed;
+        for (size_t i = 0; i < words.size(); i++) {
+            packed += words[i];
+        }
+
+        for (int g = 0; g < GAMES_PER_LENGTH; g++) {
+            const string &target = words[next_random(rng) % words.size()];
+            start_game(game, packed.data(), words.size(), target, true);
+            games++;
+
+            vector<pair<string, string>> history;   //guess, pattern
+            for (int turn = 0; turn < GUESSES_PER_GAME; turn++) {
+                string guess = next_random(rng) % 2 == 0 ? words[next_random(rng) % words.size()]
+                                                         : random_word(len, rng);
+                for (size_t i = 0; i < len; i++) {
+                    guess[i] = (char)tolower((unsigned char)guess[i]);
+                }
+
+                bool consistent = true;
+                for (size_t h = 0; h < history.size(); h++) {
+                    if (reference_score(history[h].first, guess) != history[h].second) {
+                        consistent = false;
+                    }
+                }
+
+                char pattern[MAX_WORD_LEN];
+                int result = play_guess(game, guess, pattern);
+                if (result != (consistent ? GUESS_OK : GUESS_INCONSISTENT)) {
+                    report(count, "hard mode", guess + " after " + to_string(history.size()) +
+                           " guesses at " + target + " gave " + to_string(result));
+                    break;
+                }
+                if (result != GUESS_OK) {
+                    continue;
+                }
+
+                string want = reference_score(guess, target);
+                if (string(pattern, len) != want) {
+                    report(count, "play_guess", guess + " vs " + target + " gave " +
+                           string(pattern, len) + ", want " + want);
+                    break;
+                }
+                history.push_back(make_pair(guess, want));
+
+                size_t possible = 0;
+                for (size_t w = 0; w < words.size(); w++) {
+                    bool ok = true;
+                    for (size_t h = 0; h < history.size() && ok; h++) {
+                        ok = reference_score(history[h].first, words[w]) == history[h].second;
+                    }
+                    possible += ok;
+                }
+                if (game.remaining != possible) {
+                    report(count, "remaining", "target " + target + " after " + guess + " has " +
+                           to_string(game.remaining) + ", want " + to_string(possible));
+                    break;
+                }
+            }
+        }
+    }
+    cout << (count == 0 ? "ok  " : "FAIL") << " hard mode games: " << games << " of up to "
+         << GUESSES_PER_GAME << " guesses" << endl;
+}
+
+int main(int argc, char *argv[]) {
+    string word_file = argc >= 2 ? argv[1] : WORD_FILE;
+    uint64_t rng     = argc >= 3 ? strtoull(argv[2], nullptr, 10) : 1;
+    uint64_t stride  = argc >= 4 ? strtoull(argv[3], nullptr, 10) : 1;
+    if (stride == 0) {
+        stride = 1;
+    }
+
+    WordBank bank;
+    if (!load_word_bank(word_file, bank)) {
+        cerr << "Error: Could not load words from " << word_file << endl;
+        return 1;
+    }
+
+    check_all_guesses(bank, stride);
+    check_random_pairs(bank, rng);
+    check_games(bank, rng);
+
+    if (g_failures != 0) {
+        cout << g_failures << " failures." << endl;
+        return 1;
+    }
+    cout << "All checks passed." << endl;
+    return 0;
+}
@@ -0,0 +1,159 @@
+/***********************************************************************
+ * Filename:   fuzz_commands.cpp
+ *
+ * Compile:    clang++ -g -O1 -fsanitize=fuzzer,address,undefined \
+ *                 fuzz/fuzz_commands.cpp library.cpp game.cpp shared.cpp trace.cpp \
+ *                 ratelimit.cpp difficulty.cpp profile.cpp -o fuzz_commands
+ *             //without clang: g++ -g -fsanitize=address,undefined -pthread \
+ *             //    fuzz/fuzz_commands.cpp fuzz/standalone.cpp and the same .cpp files
+ * Run:        ./fuzz_commands fuzz/corpus/commands
+ *
+ * Purpose:    libFuzzer target for command dispatch. Each input is
+ *             everything a client sends on one connection; it is fed
+ *             over a socketpair to the server's own handle_client,
+ *             with a small built-in word bank that has difficulty
+ *             tiers. Every reply must be a well-formed protocol line,
+ *             and the connection must release the word bank when it
+ *             ends.
+ ***********************************************************************/
+
+
+//the server's code, with its main() renamed so libFuzzer can supply one
+#define main server_main
+#include "../server.cpp"
+#undef main
+
+#include <thread>
+
+//every length gets words, including repeated letters
+const char *const FUZZ_WORDS[] = {
+    "bark", "noon", "tree", "oval",
+    "crane", "geese", "llama", "ocean", "sissy",
+    "banana", "letter", "planet",
+    "balloon", "chicken", "example",
+    "elephant", "mountain", "sunshine",
+};
+
+//loopback, so the rate table is exercised even though limits are off
+const uint32_t FUZZ_CLIENT_IP = 0x0100007f;
+
+//built once, reused by every input
+WorkerStats   *g_fuzz_stats   = nullptr;
+ClientSession  g_fuzz_session;
+
+
+
+/**********************************************************************
+ * Function: valid_reply
+ * Purpose:  Tell whether one line the server sent fits the protocol.
+ *
+ * Parameters:
+ *   reply - string_view; the line without its newline.
+ *
+ * Returns:
+ *   bool - true for HELLO, BYE, an ERROR or REJECT message, a count,
+ *          a word or a feedback pattern.
+ *
+ **********************************************************************/
+bool valid_reply(string_view reply) {
+    if (reply == "HELLO" || reply == "BYE") {
+        return true;
+    }
+    if (reply.substr(0, 6) == "ERROR " || reply.substr(0, 7) == "REJECT ") {
+        return true;
+    }
+    if (reply.empty()) {
+        return false;
+    }
+
+    bool digits = true, letters = true, pattern = true;
+    for (size_t i = 0; i < reply.size(); i++) {
+        char c = reply[i];
+        digits  = digits && c >= '0' && c <= '9';
+        letters = letters && c >= 'a' && c <= 'z';
+        pattern = pattern && (c == '+' || c == '?' || c == '_');
+    }
+    bool word_sized = reply.size() >= MIN_WORD_LEN && reply.size() <= MAX_WORD_LEN;
+    return digits || (word_sized && (letters || pattern));
+}
+
+extern "C" int LLVMFuzzerInitialize(int *argc, char ***argv) {
+    (void)argc;
+    (void)argv;
+
+    WordBank bank;
+    for (size_t i = 0; i < sizeof(FUZZ_WORDS) / sizeof(FUZZ_WORDS[0]); i++) {
+        size_t len = strlen(FUZZ_WORDS[i]);
+        bank.by_length[len].push_back(FUZZ_WORDS[i]);
+        bank.difficulty[len].push_back((float)(1 + bank.difficulty[len].size()));
+    }
+
+    g_shm = create_shared_segment(bank);
+    if (g_shm == nullptr) {
+        abort();
+    }
+    init_rate_table(g_shm->limits, 0, 0);
+    g_fuzz_stats = claim_worker_stats(g_shm, getpid());
+
+    //same words every run, and no per-command chatter
+    g_seeded = true;
+    g_seed   = 1;
+    cout.setstate(ios::failbit);
+    signal(SIGPIPE, SIG_IGN);
+    return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+        abort();
+    }
+
+    //read the replies while the server writes them, so neither side blocks
+    string replies;
+    thread reader([&]() {
+        char buf[4096];
+        ssize_t n;
+        while ((n = read(fds[1], buf, sizeof(buf))) > 0) {
+            replies.append(buf, (size_t)n);
+        }
+    });
+
+    //the whole client side goes in up front; handle_client sees it as it reads
+    thread writer([&]() {
+        size_t sent = 0;
+        while (sent < size) {
+            ssize_t n = write(fds[1], data + sent, size - sent);
+            if (n <= 0) {
+                break;      //the server hung up early, on BYE say
+            }
+            sent += (size_t)n;
+        }
+        shutdown(fds[1], SHUT_WR);
+    });
+
+    g_shm->next_session.store(0);
+    handle_client(fds[0], g_shm, g_fuzz_stats, FUZZ_CLIENT_IP, &g_fuzz_session);
+    writer.join();
+    reader.join();
+    close(fds[1]);
+
+    //every game's pin on the word bank is gone
+    if (g_shm->readers[0].load() != 0 || g_shm->readers[1].load() != 0) {
+        abort();
+    }
+
+    //HELLO first, then only protocol lines, each with its newline
+    if (replies.substr(0, 6) != "HELLO\n" || replies.back() != '\n') {
+        abort();
+    }
+    size_t start = 0;
+    while (start < replies.size()) {
+        size_t nl = replies.find('\n', start);
+        if (!valid_reply(string_view(replies).substr(start, nl - start))) {
+            abort();
+        }
+        start = nl + 1;
+    }
+    return 0;
+}
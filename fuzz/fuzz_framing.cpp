@@ -0,0 +1,154 @@
+/***********************************************************************
+ * Filename:   fuzz_framing.cpp
+ *
+ * Compile:    clang++ -g -O1 -fsanitize=fuzzer,address,undefined \
+ *                 fuzz/fuzz_framing.cpp library.cpp -o fuzz_framing
+ *             //without clang: g++ -g -fsanitize=address,undefined \
+ *             //    fuzz/fuzz_framing.cpp fuzz/standalone.cpp library.cpp
+ * Run:        ./fuzz_framing fuzz/corpus/framing
+ *
+ * Purpose:    libFuzzer target for receive_line. The first input byte
+ *             picks how the rest is cut into writes, so lines arrive
+ *             split across recv() calls at every possible point; the
+ *             rest is the byte stream. Every line handed back must be
+ *             exactly the next newline-terminated piece of the stream,
+ *             a line that can't fit must stop the reader, and an
+ *             unterminated tail must never come back as a line.
+ ***********************************************************************/
+
+
+#include "../library.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+
+//what the reader should do next, worked out from the stream alone
+struct ExpectedLines {
+    const uint8_t *stream;
+    size_t         size;
+    size_t         pos;         //start of the next line
+    bool           stopped;     //the reader has given up
+};
+
+
+
+/**********************************************************************
+ * Function: check_line
+ * Purpose:  Compare one line from receive_line with the next line of
+ *           the stream, and step past it.
+ *
+ * Parameters:
+ *   want - ExpectedLines&; the stream (input/output).
+ *   line - string_view; what receive_line returned.
+ *
+ * Returns:
+ *   NULL. aborts on a mismatch, which libFuzzer reports as a crash.
+ *
+ **********************************************************************/
+void check_line(ExpectedLines &want, string_view line) {
+    const uint8_t *nl = (const uint8_t *)memchr(want.stream + want.pos, '\n',
+                                                want.size - want.pos);
+    if (nl == nullptr) {
+        abort();    //a line without its newline
+    }
+    size_t len = (size_t)(nl - (want.stream + want.pos));
+    if (len >= LINE_BUFF_SIZE || line.size() != len ||
+        memcmp(line.data(), want.stream + want.pos, len) != 0) {
+        abort();    //too long to fit, or not the bytes that were sent
+    }
+    want.pos += len + 1;
+}
+
+/**********************************************************************
+ * Function: check_stop
+ * Purpose:  receive_line gave up; that is only right at a line too
+ *           long for the buffer, or at the end of the stream with no
+ *           complete line left.
+ *
+ * Parameters:
+ *   want     - ExpectedLines&; the stream (input/output).
+ *   received - size_t; bytes written to the socket so far.
+ *   closed   - bool; the writing end has been shut down.
+ *
+ * Returns:
+ *   bool - true if the reader is done for good, false if it only ran
+ *          out of data for now (the socket is non-blocking).
+ *
+ **********************************************************************/
+bool check_stop(ExpectedLines &want, size_t received, bool closed) {
+    const uint8_t *nl = (const uint8_t *)memchr(want.stream + want.pos, '\n',
+                                                received - want.pos);
+    size_t partial = nl != nullptr ? (size_t)(nl - (want.stream + want.pos))
+                                   : received - want.pos;
+    if (partial >= LINE_BUFF_SIZE) {
+        return true;    //no room for the rest of this line
+    }
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        if (nl != nullptr || closed) {
+            abort();    //waited with a whole line buffered, or past the end
+        }
+        return false;
+    }
+    if (nl != nullptr || !closed) {
+        abort();        //gave up on a line that fits
+    }
+    return true;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    if (size == 0) {
+        return 0;
+    }
+    uint64_t cuts = data[0];      //seeds the write sizes
+    ExpectedLines want = {data + 1, size - 1, 0, false};
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+        abort();
+    }
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+
+    LineReader reader;
+    init_line_reader(reader);
+
+    //write a piece, then take every line that piece completes
+    size_t sent = 0;
+    bool closed = false;
+    while (!want.stopped) {
+        if (sent < want.size) {
+            size_t n = 1 + (size_t)(next_random(cuts) % 64);
+            if (n > want.size - sent) {
+                n = want.size - sent;
+            }
+            if (write(fds[1], want.stream + sent, n) != (ssize_t)n) {
+                abort();
+            }
+            sent += n;
+        } else if (!closed) {
+            shutdown(fds[1], SHUT_WR);
+            closed = true;
+        }
+
+        while (true) {
+            string_view line;
+            errno = 0;
+            if (receive_line(fds[0], reader, line)) {
+                check_line(want, line);
+                continue;
+            }
+            want.stopped = check_stop(want, sent, closed);
+            break;
+        }
+    }
+
+    close(fds[0]);
+    close(fds[1]);
+    return 0;
+}
@@ -0,0 +1,44 @@
+/***********************************************************************
+ * Filename:   standalone.cpp
+ *
+ * Compile:    linked into a fuzz target in place of -fsanitize=fuzzer,
+ *             see fuzz_framing.cpp and fuzz_commands.cpp
+ * Run:        ./fuzz_framing <input files>
+ *
+ * Purpose:    Runs a fuzz target once on each file named on the
+ *             command line, for compilers without libFuzzer and for
+ *             replaying a crash file. Does no fuzzing of its own.
+ ***********************************************************************/
+
+
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+extern "C" __attribute__((weak)) int LLVMFuzzerInitialize(int *argc, char ***argv);
+
+int main(int argc, char *argv[]) {
+    if (LLVMFuzzerInitialize != nullptr) {
+        LLVMFuzzerInitialize(&argc, &argv);
+    }
+
+    int ran = 0;
+    for (int i = 1; i < argc; i++) {
+        ifstream fin(argv[i], ios::binary);
+        if (!fin.is_open()) {
+            cerr << "Error: Could not open " << argv[i] << endl;
+            return 1;
+        }
+        vector<uint8_t> input((istreambuf_iterator<char>(fin)), istreambuf_iterator<char>());
+        LLVMFuzzerTestOneInput(input.data(), input.size());
+        ran++;
+    }
+    cerr << "Ran " << ran << " inputs." << endl;
+    return 0;
+}
@@ -0,0 +1,119 @@
+/************************************************************/
+/* Filename: game.cpp */
+/* Purpose: server-side game state, hard mode rules and candidate tracking. */
+/************************************************************/
+
+#include "game.h"
+#include <cstring>
+
+using namespace std;
+
+const uint32_t ALL_LETTERS = (1u << 26) - 1;
+
+// Any letter anywhere, any number of times
+void reset_constraints(Constraints &c, size_t len) {
+    c.len = len;
+    for (size_t i = 0; i < MAX_WORD_LEN; i++) {
+        c.allowed[i] = ALL_LETTERS;
+    }
+    memset(c.min_count, 0, sizeof(c.min_count));
+    memset(c.max_count, (int)MAX_WORD_LEN, sizeof(c.max_count));
+}
+
+// Narrows the constraints with one scored guess
+void apply_feedback(Constraints &c, const char *guess, const char *pattern) {
+    uint8_t hits[26] = {0};     // '+' and '?' per letter in this guess
+    bool    miss[26] = {false}; // letter got a '_' somewhere in this guess
+
+    for (size_t i = 0; i < c.len; i++) {
+        int l = guess[i] - 'a';
+        if (pattern[i] == '+') {
+            c.allowed[i] = 1u << l;     //position is solved
+            hits[l]++;
+        } else {
+            c.allowed[i] &= ~(1u << l); //letter is not here
+            if (pattern[i] == '?') {
+                hits[l]++;
+            } else {
+                miss[l] = true;
+            }
+        }
+    }
+
+    for (int l = 0; l < 26; l++) {
+        if (hits[l] > c.min_count[l]) {
+            c.min_count[l] = hits[l];
+        }
+        if (miss[l] && hits[l] < c.max_count[l]) {
+            c.max_count[l] = hits[l];   //a '_' means the target has no more copies
+        }
+    }
+}
+
+// True if word could still be the answer
+bool satisfies(const Constraints &c, const char *word) {
+    uint8_t counts[26] = {0};
+    for (size_t i = 0; i < c.len; i++) {
+        int l = word[i] - 'a';
+        if (!(c.allowed[i] & (1u << l))) {
+            return false;
+        }
+        counts[l]++;
+    }
+
+    for (int l = 0; l < 26; l++) {
+        if (counts[l] < c.min_count[l] || counts[l] > c.max_count[l]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Starts a game with every word of this length still possible
+void start_game(GameSession &game, const char *words, size_t count,
+                string_view target, bool hard) {
+    game.words  = words;
+    game.count  = count;
+    game.target.assign(target.data(), target.size());  //fits the small-string buffer, no heap
+    game.len    = target.size();
+    game.score  = get_scorer(game.len);
+    game.hard   = hard;
+    reset_constraints(game.rules, game.len);
+
+    //one bit per word, the unused tail bits of the last block stay clear;
+    //assign() reuses the vector's memory from the previous game
+    size_t n = count;
+    game.candidates.assign((n + 63) / 64, ~(uint64_t)0);
+    if (n % 64 != 0) {
+        game.candidates.back() = ((uint64_t)1 << (n % 64)) - 1;
+    }
+    game.remaining = n;
+}
+
+// Scores a guess and narrows the candidates
+int play_guess(GameSession &game, string_view guess, char *pattern) {
+    if (game.score == nullptr || !validate_word(guess, game.len)) {
+        return GUESS_INVALID;
+    }
+    if (game.hard && !satisfies(game.rules, guess.data())) {
+        return GUESS_INCONSISTENT;
+    }
+
+    game.score(guess.data(), game.target.data(), pattern);
+    apply_feedback(game.rules, guess.data(), pattern);
+
+    //only words still set need checking, so each guess costs less than the last
+    for (size_t b = 0; b < game.candidates.size(); b++) {
+        uint64_t bits = game.candidates[b];
+        while (bits != 0) {
+            int bit = __builtin_ctzll(bits);
+            bits &= bits - 1;
+            if (!satisfies(game.rules, game.words + (b * 64 + bit) * game.len)) {
+                game.candidates[b] &= ~((uint64_t)1 << bit);
+                game.remaining--;
+            }
+        }
+    }
+
+    return GUESS_OK;
+}
@@ -0,0 +1,111 @@
+#ifndef GAME_H
+#define GAME_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "library.h"
+using namespace std;
+
+//results of play_guess
+const int GUESS_OK           = 0;
+const int GUESS_INVALID      = 1;   //wrong length or not letters
+const int GUESS_INCONSISTENT = 2;   //hard mode: breaks earlier feedback
+
+//everything learned from earlier feedback in one game
+struct Constraints {
+    size_t   len;
+    uint32_t allowed[MAX_WORD_LEN]; //bit c set if letter 'a'+c may sit at position i
+    uint8_t  min_count[26];         //letter must appear at least this many times
+    uint8_t  max_count[26];         //and at most this many times
+};
+
+//server-side state of one game on one connection
+struct GameSession {
+    const char *words;              //packed word bank records for this length
+    size_t   count;                 //number of records in words
+    string   target;
+    size_t   len;
+    ScoreFn  score;                 //picked once when the game starts
+    bool     hard;
+    Constraints rules;
+    vector<uint64_t> candidates;    //bit i set if word i can still be the answer
+    size_t   remaining;
+};
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  reset_constraints                                   */
+/* Description:    Clears all constraints: any letter anywhere, any    */
+/*                 count.                                              */
+/* Parameters:     Constraints &c: state to reset – output             */
+/*                 size_t len: word length of the game – input         */
+/* Return Value:   void – no return value                              */
+/*                                                                     */
+/***********************************************************************/
+
+void reset_constraints(Constraints &c, size_t len);
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  apply_feedback                                      */
+/* Description:    Folds one guess and its '+', '?', '_' pattern into  */
+/*                 the constraint state.                               */
+/* Parameters:     Constraints &c: state to update – input/output      */
+/*                 const char *guess: c.len lowercase letters – input  */
+/*                 const char *pattern: c.len pattern chars – input    */
+/* Return Value:   void – no return value                              */
+/*                                                                     */
+/***********************************************************************/
+
+void apply_feedback(Constraints &c, const char *guess, const char *pattern);
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  satisfies                                           */
+/* Description:    Checks a word against the constraint state. Cost    */
+/*                 does not depend on how many guesses were made.      */
+/* Parameters:     const Constraints &c: state to check against – input*/
+/*                 const char *word: c.len lowercase letters – input   */
+/* Return Value:   bool – true if the word is consistent with all      */
+/*                 feedback so far                                     */
+/*                                                                     */
+/***********************************************************************/
+
+bool satisfies(const Constraints &c, const char *word);
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  start_game                                          */
+/* Description:    Starts a new game: picks the scorer for the target  */
+/*                 length, clears constraints and marks every word of  */
+/*                 that length as a candidate.                         */
+/* Parameters:     GameSession &game: session to start – output        */
+/*                 const char *words: count packed records of the      */
+/*                 target's length, must outlive the game – input      */
+/*                 size_t count: number of records – input             */
+/*                 string_view target: the secret word – input         */
+/*                 bool hard: enforce hard mode – input                */
+/* Return Value:   void – no return value                              */
+/*                                                                     */
+/***********************************************************************/
+
+void start_game(GameSession &game, const char *words, size_t count,
+                string_view target, bool hard);
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  play_guess                                          */
+/* Description:    Scores a guess against the target, then narrows the */
+/*                 constraints and candidate set. In hard mode a guess */
+/*                 that breaks earlier feedback is refused unscored.   */
+/* Parameters:     GameSession &game: running game – input/output      */
+/*                 string_view guess: lowercase guess – input          */
+/*                 char *pattern: game.len pattern chars – output      */
+/* Return Value:   int – GUESS_OK, GUESS_INVALID or GUESS_INCONSISTENT */
+/*                                                                     */
+/***********************************************************************/
+
+int play_guess(GameSession &game, string_view guess, char *pattern);
+
+#endif
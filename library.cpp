@@ -18,49 +18,54 @@
 #include <fstream>  
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
 #include <unistd.h> 
 #include <errno.h>
 #include <cstring>
+#include <cstdarg>
+#include <cstdio>
 
 using namespace std;
 
 // ------------------------------
 // Removes leading and trailing whitespace
 // ------------------------------
-string trim_whitespace(const string &str) {
+string_view trim_whitespace(string_view str) {
     if (str.empty()) {  
-        return "";      //check to see if the string is empty, if it is returns empty str literal
+        return str;     //check to see if the string is empty, if it is returns it as is
     }
 
     int start = 0;          // start represents index of first char in string 
     int end = str.length() - 1;  //end is assigned to last char of the string  
 
     // Move start forward past spaces
-    while (start <= end && isspace(str[start])) {
+    while (start <= end && isspace((unsigned char)str[start])) {
         start++;
     }
 
     // Move end backward past spaces
-    while (end >= start && isspace(str[end])) {
+    while (end >= start && isspace((unsigned char)str[end])) {
         end--;
     }
 
     // If entire string was whitespace
     if (start > end) {
-        return "";
+        return string_view();
     }
 
-    return str.substr(start, end - start + 1);      //returns the trimmed string
+    return str.substr(start, end - start + 1);      //returns the trimmed view, no copy
 }
 
-// Validates that a word is 5 alphabetic letters (A–Z)
-bool validate_word(const string &word) { //loop itrerates 5 tiumes checking each char one by one 
-    if (word.length() != 5) {
+// Validates that a word is len alphabetic letters (A–Z)
+bool validate_word(string_view word, size_t len) {
+    if (!is_supported_length(len) || word.length() != len) {
         return false;
     }
 
-    for (int i = 0; i < 5; i++) {
-        if (!isalpha(word[i])) {        //isalpha used to evaluate valid letter A-Z used this example: https://www.programiz.com/cpp-programming/library-function/cctype/isalpha
+    for (size_t i = 0; i < len; i++) {
+        if (!isalpha((unsigned char)word[i])) {        //isalpha used to evaluate valid letter A-Z used this example: https://www.programiz.com/cpp-programming/library-function/cctype/isalpha
             return false; // Contains non-letter characters
         }
     }
@@ -68,67 +73,69 @@ bool validate_word(const string &word) { //loop itrerates 5 tiumes checking each
     return true; //returns true meaning word has passed validation for length and proper character
 }
 
+// True if a game can be played with words of this length
+bool is_supported_length(size_t len) {
+    return len >= MIN_WORD_LEN && len <= MAX_WORD_LEN;
+}
 
-// Compares guess with target and returns pattern
-string compare_guess(const string &guess, const string &target) {
-    string result = "_____"; // each _ represents a letter in the guess that is not present in target word
+// Picks the kernel compiled for this length, done once per game
+ScoreFn get_scorer(size_t len) {
+    switch (len) {
+        case 4: return &score_guess_n<4>;
+        case 5: return &score_guess_n<5>;
+        case 6: return &score_guess_n<6>;
+        case 7: return &score_guess_n<7>;
+        case 8: return &score_guess_n<8>;
+        default: return nullptr;
+    }
+}
 
-    // Copy of target to mark matched letters
-    string tempTarget = target;
 
-    // loop that checks for letters that match both char and index
-    for (int i = 0; i < 5; i++) { //iterates through all 4 postions
-        if (tolower(guess[i]) == tolower(tempTarget[i])) {       //Allows upper and lowercase
-            result[i] = '+';        //uses + if exact letter and position match 
-            tempTarget[i] = '*'; // temp is marked 
-        }
-    }
+// Compares guess with target and returns pattern
+string compare_guess(string_view guess, string_view target) {
+    string result(target.size(), '_'); // each _ represents a letter in the guess that is not present in target word
 
-    // belw loop checks for correct letter in wrong positions 
-    for (int i = 0; i < 5; i++) {
-        if (result[i] == '+') {     //this check skips ant pos in guess already marked as a match '+'
-            continue; 
-        }
-                //inner loop iterated through eacyh char of the tempTarget to see if guess[i] char exists
-        for (int j = 0; j < 5; j++) {
-            if (tolower(guess[i]) == tolower(tempTarget[j]) && tempTarget[j] != '*') {
-                result[i] = '?';
-                tempTarget[j] = '*'; //prevents the guess letter from matching a target letter that was already used
-                break;
-            }
-        }
+    ScoreFn score = get_scorer(target.size());
+    if (score == nullptr || guess.size() != target.size()) {
+        return result; //lengths differ or unsupported, nothing matches
     }
 
+    score(guess.data(), target.data(), &result[0]);
     return result; //final result is string ex (_?+?_)
 }
 
-//function to read words from a text file and process them into vector 
-bool load_words(const string &path, vector<string> &out_words) {
-    out_words.clear();
+//function to read words from a text file and group them by length
+bool load_word_bank(const string &path, WordBank &bank) {
+    for (size_t n = 0; n <= MAX_WORD_LEN; n++) {
+        bank.by_length[n].clear();
+        bank.difficulty[n].clear();
+    }
 
     ifstream fin(path.c_str());
     if (!fin.is_open()) {
          return false; // error checking to check if file system was open
     }
 
+    size_t total = 0;
     string line;
     while (getline(fin, line)) {
-        string w = trim_whitespace(line); //calls the trim_whitespace() function removing any whitespace 
+        string w(trim_whitespace(line)); //calls the trim_whitespace() function removing any whitespace 
 
         // loops through the arr of chars to convert to lowercase for consistency
         for (size_t i = 0; i < w.size(); i++) {
             w[i] = (char)tolower(w[i]);
         }
 
-        if (validate_word(w)) { //once again calls validate_word function to check validity of word
-            out_words.push_back(w); //if validation is passed, it is appended to out_words vector
+        if (validate_word(w, w.size())) { //once again calls validate_word function to check validity of word
+            bank.by_length[w.size()].push_back(w); //if validation is passed, it is appended to the list for its length
+            total++;
         }
         // else ignore invalid lines (could log if you want)
     }
 
     fin.close();
 
-    if (out_words.size() == 0) {
+    if (total == 0) {
         return false; //error checking to assure words were loaded in after reading file
     }
 
@@ -142,30 +149,62 @@ bool load_words(const string &path, vector<string> &out_words) {
     return true;
 }
 
+//function to read the 5-letter words from a text file into a vector
+bool load_words(const string &path, vector<string> &out_words) {
+    out_words.clear();
+
+    WordBank bank;
+    if (!load_word_bank(path, bank)) {
+        return false;
+    }
+
+    out_words = bank.by_length[DEFAULT_WORD_LEN];
+    return out_words.size() > 0;
+}
+
 
 // Returns a single rand word from the list, or "" if empty
 //https://www.cplusplus.com/reference/cstdlib/rand/ Used lofgic from this code snippet and edited it for project usage
-string get_random_word(const vector<string> &words) {
+string_view get_random_word(const vector<string> &words) {
     if (words.size() == 0) {
-        return "";
+        return string_view();
     }
     int idx = rand() % (int)words.size();   //uses  modulus to constraint the indeces of the random number 
     return words[(size_t)idx];
 }
 
-//function reliably ensures a string of data can be sent over a network socket
-bool send_message(int sockfd, const string &data) {
-    string line = data; //variable line contains the entire message
-    line.push_back('\n'); //adds null term to signify end of message 
+// splitmix64, see https://prng.di.unimi.it/splitmix64.c
+uint64_t next_random(uint64_t &state) {
+    uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
 
-    const char *buf = line.c_str();
-    int total = 0; 
-    int to_send = (int)line.size();     //total num of bytes in package 
+//function reliably ensures a string of data can be sent over a network socket
+bool send_message(int sockfd, string_view data) {
+    //data and the newline go out together from two pieces, so nothing is copied
+    static const char newline = '\n';
+    struct iovec iov[2];
+    iov[0].iov_base = (void *)data.data();
+    iov[0].iov_len  = data.size();
+    iov[1].iov_base = (void *)&newline;
+    iov[1].iov_len  = 1;
+
+    struct msghdr mh;
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov    = iov;
+    mh.msg_iovlen = 2;
 
     //https://beej.us/guide/bgnet/html/split/client-server-background.html#sending-a-complete-buffer used beej's guide for the while loop portion for data to be sent incrementally
-    while (total < to_send) { //loop iterates while the total num bytes sent (initally starts at 0) equal total size
-        int n = (int)send(sockfd, buf + total, to_send - total, 0);
+    while (mh.msg_iovlen > 0) { //loop iterates until every piece has been sent
+        uint64_t span = span_begin();
+        ssize_t n = sendmsg(sockfd, &mh, 0);
+        span_end(SPAN_SEND, span);
         if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
             // send error
             return false;
         }
@@ -173,7 +212,17 @@ bool send_message(int sockfd, const string &data) {
             // peer closed unexpectedly
             return false;
         }
-        total += n;
+
+        //skip whatever was sent, possibly stopping partway through a piece
+        while (mh.msg_iovlen > 0 && (size_t)n >= mh.msg_iov[0].iov_len) {
+            n -= (ssize_t)mh.msg_iov[0].iov_len;
+            mh.msg_iov++;
+            mh.msg_iovlen--;
+        }
+        if (mh.msg_iovlen > 0) {
+            mh.msg_iov[0].iov_base = (char *)mh.msg_iov[0].iov_base + n;
+            mh.msg_iov[0].iov_len -= (size_t)n;
+        }
     }
     return true;
 }
@@ -217,6 +266,191 @@ bool receive_message(int sockfd, string &out) {
     }
 }
 
+// Empties the reader before the first receive_line
+void init_line_reader(LineReader &reader) {
+    reader.start = 0;
+    reader.end   = 0;
+}
+
+// Returns the next line as a view into the reader, keeping any bytes after it
+bool receive_line(int sockfd, LineReader &reader, string_view &line) {
+    size_t scanned = reader.start;  //bytes before this are known to have no newline
+
+    while (true) {
+        const char *nl = (const char *)memchr(reader.buf + scanned, '\n', reader.end - scanned);
+        if (nl != nullptr) {
+            size_t pos = (size_t)(nl - reader.buf);
+            line = string_view(reader.buf + reader.start, pos - reader.start);
+            reader.start = pos + 1;
+            return true;
+        }
+        scanned = reader.end;
+
+        //make room: slide the partial line to the front of the buffer
+        if (reader.end == LINE_BUFF_SIZE) {
+            if (reader.start == 0) {
+                return false;   //line does not fit in the buffer
+            }
+            memmove(reader.buf, reader.buf + reader.start, reader.end - reader.start);
+            reader.end -= reader.start;
+            scanned    -= reader.start;
+            reader.start = 0;
+        }
+
+        uint64_t span = span_begin();
+        ssize_t n = recv(sockfd, reader.buf + reader.end, LINE_BUFF_SIZE - reader.end, 0);
+        span_end(SPAN_RECV, span);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;   //error or closed connection
+        }
+        reader.end += (size_t)n;
+    }
+}
+
+// True if receive_line has a whole line without calling recv()
+bool line_pending(const LineReader &reader) {
+    return memchr(reader.buf + reader.start, '\n', reader.end - reader.start) != nullptr;
+}
+
+// Nothing queued
+void init_reply_buffer(ReplyBuffer &out) {
+    out.used = 0;
+}
+
+// Appends a message and its newline, making room first if needed
+bool queue_reply(int sockfd, ReplyBuffer &out, string_view data) {
+    if (data.size() + 1 > REPLY_BUFF_SIZE - out.used) {
+        if (!flush_replies(sockfd, out)) {
+            return false;
+        }
+        if (data.size() + 1 > REPLY_BUFF_SIZE) {
+            return send_message(sockfd, data);  //never fits; keep the order and send it now
+        }
+    }
+    memcpy(out.buf + out.used, data.data(), data.size());
+    out.buf[out.used + data.size()] = '\n';
+    out.used += data.size() + 1;
+    return true;
+}
+
+// Sends the queued replies; the buffer always ends in a newline, which
+// send_message supplies itself
+bool flush_replies(int sockfd, ReplyBuffer &out) {
+    if (out.used == 0) {
+        return true;
+    }
+    bool ok = send_message(sockfd, string_view(out.buf, out.used - 1));
+    out.used = 0;
+    return ok;
+}
+
+// Points the arena at its buffer
+void arena_init(Arena &arena, char *buf, size_t cap) {
+    arena.base = buf;
+    arena.used = 0;
+    arena.cap  = cap;
+}
+
+// Frees everything in the arena at once
+void arena_reset(Arena &arena) {
+    arena.used = 0;
+}
+
+// Bumps the arena forward by n bytes
+char *arena_alloc(Arena &arena, size_t n) {
+    if (n > arena.cap - arena.used) {
+        return nullptr;
+    }
+    char *p = arena.base + arena.used;
+    arena.used += n;
+    return p;
+}
+
+// printf into whatever room is left in the arena
+string_view arena_format(Arena &arena, const char *fmt, ...) {
+    size_t room = arena.cap - arena.used;
+    if (room == 0) {
+        return string_view();
+    }
+
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(arena.base + arena.used, room, fmt, ap);
+    va_end(ap);
+    if (n < 0) {
+        return string_view();
+    }
+
+    size_t len = (size_t)n < room ? (size_t)n : room - 1;   //vsnprintf truncated
+    char *p = arena_alloc(arena, len + 1);
+    return string_view(p, len);
+}
+
+// Sends fd as ancillary data along with a one-byte message
+bool send_fd(int sockfd, int fd) {
+    char byte = 'F';
+    struct iovec iov;
+    iov.iov_base = &byte;
+    iov.iov_len  = 1;
+
+    //control buffer sized and aligned for one descriptor
+    union {
+        char           buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    struct msghdr mh;
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov        = &iov;
+    mh.msg_iovlen     = 1;
+    mh.msg_control    = control.buf;
+    mh.msg_controllen = sizeof(control.buf);
+
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&mh);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type  = SCM_RIGHTS;
+    cm->cmsg_len   = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cm), &fd, sizeof(int));
+
+    return sendmsg(sockfd, &mh, 0) == 1;
+}
+
+// Receives the descriptor sent by send_fd
+int receive_fd(int sockfd) {
+    char byte;
+    struct iovec iov;
+    iov.iov_base = &byte;
+    iov.iov_len  = 1;
+
+    union {
+        char           buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+
+    struct msghdr mh;
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov        = &iov;
+    mh.msg_iovlen     = 1;
+    mh.msg_control    = control.buf;
+    mh.msg_controllen = sizeof(control.buf);
+
+    if (recvmsg(sockfd, &mh, 0) != 1) {
+        return -1;
+    }
+
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&mh);
+    if (cm == nullptr || cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS) {
+        return -1;
+    }
+    int fd;
+    memcpy(&fd, CMSG_DATA(cm), sizeof(int));
+    return fd;
+}
+
 //designed to write a timestamped message to a file named log.txt. It ensures that new messages are appended to the end of the file
 void log_event(const string &msg) {
     // Open log file in append mode
@@ -260,3 +494,112 @@ void close_connection(int sockfd) {
     }
 }
 
+
+
+
+// ------------------------------
+// Tracing spans
+// ------------------------------
+
+bool g_spans_enabled = false;
+
+//one thread's spans, and a clock reading to turn its ticks into time
+struct SpanRing {
+    uint64_t   head;        //spans recorded so far; the next goes at head % size
+    uint64_t   base_ticks;
+    uint64_t   base_ns;
+    SpanRecord records[SPAN_RING_SIZE];
+};
+
+static thread_local SpanRing *t_spans = nullptr;
+
+static const char *const SPAN_NAMES[NUM_SPANS] = {
+    "recv", "parse", "select", "score", "send", "command"
+};
+
+// Monotonic clock in nanoseconds, the time base of the dump
+static uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+bool enable_spans() {
+    if (t_spans == nullptr) {
+        t_spans = (SpanRing *)calloc(1, sizeof(SpanRing));
+        if (t_spans == nullptr) {
+            return false;
+        }
+        t_spans->base_ticks = span_clock();
+        t_spans->base_ns    = monotonic_ns();
+    }
+    g_spans_enabled = true;
+    return true;
+}
+
+void span_record(int stage, uint64_t start) {
+    SpanRing *ring = t_spans;
+    if (ring == nullptr || start == 0) {
+        return;
+    }
+    SpanRecord &r = ring->records[ring->head & (SPAN_RING_SIZE - 1)];
+    r.start = start;
+    r.ticks = span_clock() - start;
+    r.stage = (uint64_t)stage;
+    ring->head++;
+}
+
+// Writes to a file through a stack buffer, so dumping doesn't allocate
+static bool flush_out(int fd, char *buf, size_t &used) {
+    bool ok = write(fd, buf, used) == (ssize_t)used;
+    used = 0;
+    return ok;
+}
+
+bool dump_spans(const string &path) {
+    SpanRing *ring = t_spans;
+    if (ring == nullptr) {
+        return false;
+    }
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        return false;
+    }
+
+    //ticks per nanosecond, measured over the whole time tracing has been on
+    uint64_t now_ticks = span_clock();
+    uint64_t now_ns    = monotonic_ns();
+    double ns_per_tick = 1.0;
+    if (now_ticks > ring->base_ticks) {
+        ns_per_tick = (double)(now_ns - ring->base_ns) / (double)(now_ticks - ring->base_ticks);
+    }
+
+    char buf[8192];
+    size_t used = 0;
+    bool ok = true;
+    int pid = (int)getpid();
+    int tid = (int)syscall(SYS_gettid);
+    used += snprintf(buf + used, sizeof(buf) - used, "{\"traceEvents\":[\n");
+
+    uint64_t count = ring->head < SPAN_RING_SIZE ? ring->head : SPAN_RING_SIZE;
+    for (uint64_t i = ring->head - count; i < ring->head; i++) {
+        const SpanRecord &r = ring->records[i & (SPAN_RING_SIZE - 1)];
+        double ts  = ((double)ring->base_ns +
+                      (double)(int64_t)(r.start - ring->base_ticks) * ns_per_tick) / 1000.0;
+        double dur = (double)r.ticks * ns_per_tick / 1000.0;
+        if (sizeof(buf) - used < 160) {
+            ok = flush_out(fd, buf, used) && ok;
+        }
+        used += snprintf(buf + used, sizeof(buf) - used,
+                         "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                         "\"pid\":%d,\"tid\":%d}\n",
+                         i == ring->head - count ? "" : ",",
+                         SPAN_NAMES[r.stage < (uint64_t)NUM_SPANS ? r.stage : 0],
+                         ts, dur, pid, tid);
+    }
+
+    used += snprintf(buf + used, sizeof(buf) - used, "],\"displayTimeUnit\":\"ns\"}\n");
+    ok = flush_out(fd, buf, used) && ok;
+    close(fd);
+    return ok;
+}
@@ -2,47 +2,163 @@
 #define LIBRARY_H
 
 #include <string>
+#include <string_view>
 #include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 using namespace std;
 
+//supported word lengths; 5 is the classic game
+const size_t MIN_WORD_LEN     = 4;
+const size_t MAX_WORD_LEN     = 8;
+const size_t DEFAULT_WORD_LEN = 5;
+
+//scoring kernel signature: writes one '+', '?' or '_' per letter to out
+typedef void (*ScoreFn)(const char *guess, const char *target, char *out);
+
+//word bank grouped by length, by_length[n] holds every n-letter word;
+//difficulty[n] scores them in the same order, empty without an index
+struct WordBank {
+    vector<string> by_length[MAX_WORD_LEN + 1];
+    vector<float>  difficulty[MAX_WORD_LEN + 1];
+};
+
+//longest line receive_line accepts, including the newline
+const size_t LINE_BUFF_SIZE = 1024;
+
+//per-connection receive buffer; bytes after a newline are kept for the next line
+struct LineReader {
+    char   buf[LINE_BUFF_SIZE];
+    size_t start;   //first byte not yet returned
+    size_t end;     //one past the last byte received
+};
+
+//most reply bytes held back to go out in one send, newlines included
+const size_t REPLY_BUFF_SIZE = 1024;
+
+//per-connection send buffer; replies queue here so a run of pipelined
+//commands is answered with one send instead of one per reply
+struct ReplyBuffer {
+    char   buf[REPLY_BUFF_SIZE];
+    size_t used;
+};
+
+//bump allocator over a caller-provided buffer, reset after every command
+struct Arena {
+    char  *base;
+    size_t used;
+    size_t cap;
+};
+
+//stages timed by tracing spans
+const int SPAN_RECV    = 0;     //waiting in recv() for more of a command
+const int SPAN_PARSE   = 1;     //trimming and splitting a command
+const int SPAN_SELECT  = 2;     //picking a word and starting the game
+const int SPAN_SCORE   = 3;     //scoring a guess and narrowing the candidates
+const int SPAN_SEND    = 4;     //sendmsg() of a reply
+const int SPAN_COMMAND = 5;     //one whole command, received to reply queued
+const int NUM_SPANS    = 6;
+
+//spans kept per thread; the oldest are overwritten. Power of two
+const size_t SPAN_RING_SIZE = 4096;
+
+//one finished span, in span_clock() ticks
+struct SpanRecord {
+    uint64_t start;
+    uint64_t ticks;
+    uint64_t stage;
+};
+
+//set by enable_spans(); the only thing a hook checks while tracing is off
+extern bool g_spans_enabled;
+
 /***********************************************************************/
 /*                                                                     */
 /* Function name:  trim_whitespace                                     */
 /* Description:    Removes spaces, tabs, and newlines from the start   */
 /*                 and end of a string.                                */
-/* Parameters:     const string &str: original string to be cleaned –  */
+/* Parameters:     string_view str: original string to be cleaned –    */
 /*                 input                                               */
-/* Return Value:   string – the trimmed version of the original        */
-/*                 string                                              */
+/* Return Value:   string_view – the trimmed part of str, pointing     */
+/*                 into the same memory                                */
 /*                                                                     */
 /***********************************************************************/
-string trim_whitespace(const string &str);
+string_view trim_whitespace(string_view str);
 
 
 /***********************************************************************/
 /*                                                                     */
 /* Function name:  validate_word                                       */
-/* Description:    Checks if a word is exactly 5 alphabetic letters.   */
-/* Parameters:     const string &word: word to be checked – input      */
-/* Return Value:   bool – true if the word is 5 letters A–Z, false     */
-/*                 otherwise                                           */
+/* Description:    Checks if a word is exactly len alphabetic letters. */
+/* Parameters:     string_view word: word to be checked – input        */
+/*                 size_t len: required length, defaults to 5 – input  */
+/* Return Value:   bool – true if the word is len letters A–Z, false   */
+/*                 otherwise or if len is not a supported length       */
+/*                                                                     */
+/***********************************************************************/
+
+bool validate_word(string_view word, size_t len = DEFAULT_WORD_LEN);
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  is_supported_length                                 */
+/* Description:    Checks if a word length is between MIN_WORD_LEN and */
+/*                 MAX_WORD_LEN.                                       */
+/* Parameters:     size_t len: word length to check – input            */
+/* Return Value:   bool – true if a game can be played at this length  */
 /*                                                                     */
 /***********************************************************************/
 
-bool validate_word(const string &word);
+bool is_supported_length(size_t len);
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  get_scorer                                          */
+/* Description:    Returns the scoring kernel compiled for one word    */
+/*                 length. Call once per game and reuse the pointer    */
+/*                 for every guess.                                    */
+/* Parameters:     size_t len: word length of the game – input         */
+/* Return Value:   ScoreFn – score_guess_n<len>, or nullptr if the     */
+/*                 length is not supported                             */
+/*                                                                     */
+/***********************************************************************/
+
+ScoreFn get_scorer(size_t len);
 
 /***********************************************************************/
 /*                                                                     */
 /* Function name:  compare_guess                                       */
 /* Description:    Compares a player’s guess to the target word and    */
 /*                 builds a feedback pattern using '+', '?', and '_'.  */
-/* Parameters:     const string &guess: player’s guessed word – input  */
-/*                 const string &target: correct word – input          */
+/* Parameters:     string_view guess: player’s guessed word – input    */
+/*                 string_view target: correct word – input            */
 /* Return Value:   string – pattern showing correctness of each letter */
+/*                 (all '_' if the lengths differ or are unsupported)  */
 /*                                                                     */
 /***********************************************************************/
 
-string compare_guess(const string &guess, const string &target);
+string compare_guess(string_view guess, string_view target);
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  load_word_bank                                      */
+/* Description:    Reads words from a text file and groups them by     */
+/*                 length. Keeps every valid word of a supported       */
+/*                 length (MIN_WORD_LEN to MAX_WORD_LEN).              */
+/* Parameters:     const string &path: name/path of the word file –    */
+/*                 input                                               */
+/*                 WordBank &bank: words grouped by length – output    */
+/* Return Value:   bool – true if at least one word was loaded, false  */
+/*                 if the file could not be opened or had no valid     */
+/*                 words                                               */
+/*                                                                     */
+/***********************************************************************/
+
+bool load_word_bank(const string &path, WordBank &bank);
 
 /***********************************************************************/
 /*                                                                     */
@@ -68,26 +184,42 @@ bool   load_words(const string &path, vector<string> &out_words);
 /*                 vector.                                             */
 /* Parameters:     const vector<string> &words: list of valid words –  */
 /*                 input                                               */
-/* Return Value:   string – a single randomly chosen word, or empty    */
-/*                 string if the list is empty                         */
+/* Return Value:   string_view – a single randomly chosen word, valid  */
+/*                 while words is unchanged, or empty if the list is   */
+/*                 empty                                               */
+/*                                                                     */
+/***********************************************************************/
+
+string_view get_random_word(const vector<string> &words);
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  next_random                                         */
+/* Description:    Small seedable random number generator              */
+/*                 (splitmix64). Unlike rand(), each caller keeps its  */
+/*                 own state, so a given seed always gives the same    */
+/*                 sequence.                                           */
+/* Parameters:     uint64_t &state: generator state, any seed to start */
+/*                 – input/output                                      */
+/* Return Value:   uint64_t – next random number                       */
 /*                                                                     */
 /***********************************************************************/
 
-string get_random_word(const vector<string> &words);
+uint64_t next_random(uint64_t &state);
 
 /***********************************************************************/
 /*                                                                     */
 /* Function name:  send_message                                        */
 /* Description:    Sends a full line of text over a socket, ending     */
-/*                 with a newline character.                           */
+/*                 with a newline character. Does not copy data.       */
 /* Parameters:     int sockfd: socket file descriptor – input          */
-/*                 const string &data: message to send – input         */
+/*                 string_view data: message to send – input           */
 /* Return Value:   bool – true if the whole message was sent           */
 /*                 successfully, false on error                        */
 /*                                                                     */
 /***********************************************************************/
 
-bool send_message(int sockfd, const string &data);
+bool send_message(int sockfd, string_view data);
 
 /***********************************************************************/
 /*                                                                     */
@@ -104,6 +236,161 @@ bool send_message(int sockfd, const string &data);
 
 bool receive_message(int sockfd, string &out);
 
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  init_line_reader                                    */
+/* Description:    Empties a LineReader before its first use.          */
+/* Parameters:     LineReader &reader: reader to clear – output        */
+/* Return Value:   void – no return value                              */
+/*                                                                     */
+/***********************************************************************/
+
+void init_line_reader(LineReader &reader);
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  receive_line                                        */
+/* Description:    Like receive_message but without allocating: the    */
+/*                 line is returned as a view into reader's buffer,    */
+/*                 and anything received after the newline is kept    */
+/*                 for the next call.                                  */
+/* Parameters:     int sockfd: socket file descriptor – input          */
+/*                 LineReader &reader: this connection's buffer –      */
+/*                 input/output                                        */
+/*                 string_view &line: the line without its newline,    */
+/*                 valid until the next call – output                  */
+/* Return Value:   bool – true if a line was received, false on error, */
+/*                 closed connection or a line longer than             */
+/*                 LINE_BUFF_SIZE                                      */
+/*                                                                     */
+/***********************************************************************/
+
+bool receive_line(int sockfd, LineReader &reader, string_view &line);
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  line_pending                                        */
+/* Description:    Tells whether the next receive_line can return      */
+/*                 without waiting, because a whole line is already    */
+/*                 in the buffer.                                      */
+/* Parameters:     const LineReader &reader: connection's buffer –     */
+/*                 input                                               */
+/* Return Value:   bool – true if a complete line is buffered          */
+/*                                                                     */
+/***********************************************************************/
+
+bool line_pending(const LineReader &reader);
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  init_reply_buffer                                   */
+/* Description:    Empties a ReplyBuffer before its first use.         */
+/* Parameters:     ReplyBuffer &out: buffer to clear – output          */
+/* Return Value:   void – no return value                              */
+/*                                                                     */
+/***********************************************************************/
+
+void init_reply_buffer(ReplyBuffer &out);
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  queue_reply                                         */
+/* Description:    Like send_message, but the message and its newline  */
+/*                 are added to out and sent later by flush_replies.   */
+/*                 Sends what is queued first if the message does not  */
+/*                 fit, and a message bigger than the whole buffer     */
+/*                 straight away.                                      */
+/* Parameters:     int sockfd: socket file descriptor – input          */
+/*                 ReplyBuffer &out: this connection's buffer –        */
+/*                 input/output                                        */
+/*                 string_view data: message to send – input           */
+/* Return Value:   bool – false if a send it had to make failed        */
+/*                                                                     */
+/***********************************************************************/
+
+bool queue_reply(int sockfd, ReplyBuffer &out, string_view data);
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  flush_replies                                       */
+/* Description:    Sends everything queued in out with one sendmsg()   */
+/*                 (more only if the socket takes it in pieces) and    */
+/*                 empties it. Cheap when nothing is queued.           */
+/* Parameters:     int sockfd: socket file descriptor – input          */
+/*                 ReplyBuffer &out: this connection's buffer –        */
+/*                 input/output                                        */
+/* Return Value:   bool – true if everything was sent                  */
+/*                                                                     */
+/***********************************************************************/
+
+bool flush_replies(int sockfd, ReplyBuffer &out);
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  arena_init / arena_reset                            */
+/* Description:    Point an arena at a buffer, and free everything     */
+/*                 allocated from it at once.                          */
+/* Parameters:     Arena &arena: arena to set up or reset – output     */
+/*                 char *buf: backing memory – input                   */
+/*                 size_t cap: size of buf – input                     */
+/* Return Value:   void – no return value                              */
+/*                                                                     */
+/***********************************************************************/
+
+void arena_init(Arena &arena, char *buf, size_t cap);
+void arena_reset(Arena &arena);
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  arena_alloc                                         */
+/* Description:    Takes n bytes from the arena.                       */
+/* Parameters:     Arena &arena: arena to allocate from – input/output */
+/*                 size_t n: number of bytes – input                   */
+/* Return Value:   char* – the bytes, or nullptr if the arena is full  */
+/*                                                                     */
+/***********************************************************************/
+
+char *arena_alloc(Arena &arena, size_t n);
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  arena_format                                        */
+/* Description:    printf into the arena.                              */
+/* Parameters:     Arena &arena: arena to allocate from – input/output */
+/*                 const char *fmt, ...: printf format and values –    */
+/*                 input                                               */
+/* Return Value:   string_view – the formatted text, cut short if the  */
+/*                 arena is full                                       */
+/*                                                                     */
+/***********************************************************************/
+
+string_view arena_format(Arena &arena, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  send_fd                                             */
+/* Description:    Passes an open file descriptor to another process   */
+/*                 over a connected Unix domain socket (SCM_RIGHTS).   */
+/* Parameters:     int sockfd: connected AF_UNIX socket – input        */
+/*                 int fd: descriptor to pass – input                  */
+/* Return Value:   bool – true if the descriptor was sent              */
+/*                                                                     */
+/***********************************************************************/
+
+bool send_fd(int sockfd, int fd);
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  receive_fd                                          */
+/* Description:    Receives a file descriptor sent with send_fd.       */
+/* Parameters:     int sockfd: connected AF_UNIX socket – input        */
+/* Return Value:   int – the new descriptor, or -1 on error            */
+/*                                                                     */
+/***********************************************************************/
+
+int receive_fd(int sockfd);
+
 /***********************************************************************/
 /*                                                                     */
 /* Function name:  log_event                                           */
@@ -142,4 +429,124 @@ void error_exit(const string &msg);
 
 void close_connection(int sockfd);
 
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  enable_spans                                        */
+/* Description:    Gives the calling thread a span ring buffer and     */
+/*                 turns span recording on for the process. Spans from */
+/*                 threads without a ring are dropped.                 */
+/* Parameters:     none                                                */
+/* Return Value:   bool – false if the ring could not be allocated     */
+/*                                                                     */
+/***********************************************************************/
+
+bool enable_spans();
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  span_record                                         */
+/* Description:    Slow path of span_end: stores one span in the       */
+/*                 calling thread's ring.                              */
+/* Parameters:     int stage: SPAN_* – input                           */
+/*                 uint64_t start: from span_begin, 0 to skip – input  */
+/* Return Value:   void – no return value                              */
+/*                                                                     */
+/***********************************************************************/
+
+void span_record(int stage, uint64_t start);
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  dump_spans                                          */
+/* Description:    Writes the calling thread's ring, oldest span       */
+/*                 first, as Chrome trace-event JSON ("X" events, time */
+/*                 in microseconds on CLOCK_MONOTONIC), for            */
+/*                 chrome://tracing or ui.perfetto.dev.                */
+/* Parameters:     const string &path: output file – input             */
+/* Return Value:   bool – false if tracing is off or the file could    */
+/*                 not be written                                      */
+/*                                                                     */
+/***********************************************************************/
+
+bool dump_spans(const string &path);
+
+
+// ------------------------------
+// Length-specialized kernels. These live in the header so the compiler
+// sees N as a constant and unrolls the loops; the 5-letter instance ends
+// up as straight-line code. Use get_scorer() to pick one at runtime.
+// ------------------------------
+
+//ASCII-only helper so the kernels can be constexpr (tolower is not)
+constexpr char ascii_lower(char c) {
+    return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+}
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  score_guess_n                                       */
+/* Description:    Same rules as compare_guess for an N-letter word,   */
+/*                 using letter counts instead of a nested loop.       */
+/* Parameters:     const char *guess: N letters – input                */
+/*                 const char *target: N letters – input               */
+/*                 char *out: N pattern chars, not terminated – output */
+/* Return Value:   void – no return value                              */
+/*                                                                     */
+/***********************************************************************/
+
+template <size_t N>
+constexpr void score_guess_n(const char *guess, const char *target, char *out) {
+    int counts[26] = {};    //unmatched target letters still available for '?'
+
+    //exact matches first, counting the target letters they did not use
+    for (size_t i = 0; i < N; i++) {
+        char g = ascii_lower(guess[i]);
+        char t = ascii_lower(target[i]);
+        if (g == t) {
+            out[i] = '+';
+        } else {
+            out[i] = '_';
+            if (t >= 'a' && t <= 'z') {
+                counts[t - 'a']++;
+            }
+        }
+    }
+
+    //then right letter, wrong spot, each target letter used at most once
+    for (size_t i = 0; i < N; i++) {
+        char g = ascii_lower(guess[i]);
+        if (out[i] == '_' && g >= 'a' && g <= 'z' && counts[g - 'a'] > 0) {
+            out[i] = '?';
+            counts[g - 'a']--;
+        }
+    }
+}
+
+// ------------------------------
+// Span hooks. Inline so that with tracing off each one is a load and a
+// well-predicted branch on g_spans_enabled, and nothing else.
+// ------------------------------
+
+//cycle counter where there is one, monotonic nanoseconds elsewhere
+inline uint64_t span_clock() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+//start of a span, 0 while tracing is off
+inline uint64_t span_begin() {
+    return g_spans_enabled ? span_clock() : 0;
+}
+
+inline void span_end(int stage, uint64_t start) {
+    if (g_spans_enabled) {
+        span_record(stage, start);
+    }
+}
+
 #endif
@@ -0,0 +1,235 @@
+/************************************************************/
+/* Filename: profile.cpp */
+/* Purpose: sampling CPU profiler for server workers, using perf_event_open. */
+/************************************************************/
+
+#include "profile.h"
+#include <map>
+#include <vector>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <linux/perf_event.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+
+//the kernel's sample buffer for this thread, and what has been read from it
+static int                          g_perf_fd   = -1;
+static struct perf_event_mmap_page *g_perf_page = nullptr;
+
+//one distinct call stack, innermost frame first: depth frames of
+//g_frames starting at first. depth 0 marks a free slot
+struct StackCount {
+    uint64_t hash;
+    uint32_t first;
+    uint32_t depth;
+    uint64_t count;
+};
+
+//samples so far, by call stack, in an open-addressing table kept at most
+//half full; frames go in g_frames, reserved up front and filled in order.
+//Both are sized by start_profiler, so drain_profiler never allocates
+static vector<StackCount> g_stacks;
+static vector<uint64_t>   g_frames;
+static int                g_stack_count = 0;
+
+//samples the kernel dropped, and samples whose stack found no room here
+static uint64_t g_lost    = 0;
+static uint64_t g_dropped = 0;
+
+bool start_profiler() {
+    struct perf_event_attr pa;
+    memset(&pa, 0, sizeof(pa));
+    pa.size        = sizeof(pa);
+    pa.type        = PERF_TYPE_SOFTWARE;
+    pa.config      = PERF_COUNT_SW_TASK_CLOCK;   //only while this thread runs
+    pa.freq        = 1;
+    pa.sample_freq = PROFILE_HZ;
+    pa.sample_type = PERF_SAMPLE_CALLCHAIN;
+    pa.exclude_kernel           = 1;
+    pa.exclude_hv               = 1;
+    pa.exclude_callchain_kernel = 1;
+    pa.sample_max_stack         = PROFILE_MAX_DEPTH;
+
+    int fd = (int)syscall(SYS_perf_event_open, &pa, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+    if (fd == -1) {
+        perror("perf_event_open");
+        return false;
+    }
+
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    void *mem = mmap(nullptr, (PROFILE_PAGES + 1) * page, PROT_READ | PROT_WRITE,
+                     MAP_SHARED, fd, 0);
+    if (mem == MAP_FAILED) {
+        perror("perf mmap");
+        close(fd);
+        return false;
+    }
+    g_perf_fd   = fd;
+    g_perf_page = (struct perf_event_mmap_page *)mem;
+
+    //reserved, not filled: frame pages are only touched as stacks show up
+    g_stacks.assign(2 * PROFILE_MAX_STACKS, StackCount());
+    g_frames.reserve((size_t)PROFILE_MAX_STACKS * PROFILE_MAX_DEPTH);
+    return true;
+}
+
+// Copies n bytes starting at position pos of the circular data area
+static void ring_copy(const char *data, uint64_t size, uint64_t pos, void *out, size_t n) {
+    size_t off   = (size_t)(pos % size);
+    size_t first = n < size - off ? n : (size_t)(size - off);
+    memcpy(out, data + off, first);
+    memcpy((char *)out + first, data, n - first);
+}
+
+// Mixes each frame into a 64-bit hash, FNV style
+static uint64_t hash_stack(const uint64_t *frames, size_t depth) {
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < depth; i++) {
+        h = (h ^ frames[i]) * 1099511628211ULL;
+        h ^= h >> 29;
+    }
+    return h;
+}
+
+// Counts one sample of a stack, adding the stack if it is new and fits
+static void count_stack(const uint64_t *frames, size_t depth) {
+    uint64_t h = hash_stack(frames, depth);
+    size_t mask = g_stacks.size() - 1;
+    for (size_t i = (size_t)h & mask;; i = (i + 1) & mask) {
+        StackCount &s = g_stacks[i];
+        if (s.depth == 0) {
+            if (g_stack_count == PROFILE_MAX_STACKS ||
+                g_frames.size() + depth > g_frames.capacity()) {
+                g_dropped++;
+                return;
+            }
+            s.hash  = h;
+            s.first = (uint32_t)g_frames.size();
+            s.depth = (uint32_t)depth;
+            s.count = 1;
+            g_frames.insert(g_frames.end(), frames, frames + depth);    //within capacity
+            g_stack_count++;
+            return;
+        }
+        if (s.hash == h && s.depth == depth &&
+            memcmp(&g_frames[s.first], frames, depth * sizeof(uint64_t)) == 0) {
+            s.count++;
+            return;
+        }
+    }
+}
+
+void drain_profiler() {
+    if (g_perf_page == nullptr) {
+        return;
+    }
+    const char *data = (const char *)g_perf_page + g_perf_page->data_offset;
+    uint64_t size = g_perf_page->data_size;
+    uint64_t head = __atomic_load_n(&g_perf_page->data_head, __ATOMIC_ACQUIRE);
+    uint64_t tail = g_perf_page->data_tail;
+
+    while (tail < head) {
+        struct perf_event_header hdr;
+        ring_copy(data, size, tail, &hdr, sizeof(hdr));
+        if (hdr.size == 0) {
+            break;
+        }
+
+        if (hdr.type == PERF_RECORD_SAMPLE) {
+            //sample_max_stack caps the frames; the rest are context markers
+            uint64_t ips[PROFILE_MAX_DEPTH + 8];
+            uint64_t nr = 0;
+            ring_copy(data, size, tail + sizeof(hdr), &nr, sizeof(nr));
+            if (nr > sizeof(ips) / sizeof(ips[0])) {
+                nr = sizeof(ips) / sizeof(ips[0]);
+            }
+            ring_copy(data, size, tail + sizeof(hdr) + sizeof(nr), ips, nr * sizeof(uint64_t));
+
+            //drop the markers the kernel puts between kernel and user frames
+            size_t depth = 0;
+            for (size_t i = 0; i < nr && depth < (size_t)PROFILE_MAX_DEPTH; i++) {
+                if (ips[i] < (uint64_t)PERF_CONTEXT_MAX) {
+                    ips[depth++] = ips[i];
+                }
+            }
+            if (depth > 0) {
+                count_stack(ips, depth);
+            }
+        } else if (hdr.type == PERF_RECORD_LOST) {
+            uint64_t lost[2];     //id, count
+            ring_copy(data, size, tail + sizeof(hdr), lost, sizeof(lost));
+            g_lost += lost[1];
+        }
+        tail += hdr.size;
+    }
+    __atomic_store_n(&g_perf_page->data_tail, tail, __ATOMIC_RELEASE);
+}
+
+// Function name for an address, or binary+offset when it has no exported name
+static string frame_name(uint64_t ip) {
+    Dl_info info;
+    if (dladdr((void *)ip, &info) == 0) {
+        char hex[32];
+        snprintf(hex, sizeof(hex), "0x%llx", (unsigned long long)ip);
+        return hex;
+    }
+    if (info.dli_sname != nullptr) {
+        int status = -1;
+        char *plain = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+        string name = status == 0 ? plain : info.dli_sname;
+        free(plain);
+        return name;
+    }
+    const char *file = strrchr(info.dli_fname, '/');
+    char where[256];
+    snprintf(where, sizeof(where), "%s+0x%llx", file != nullptr ? file + 1 : info.dli_fname,
+             (unsigned long long)(ip - (uint64_t)info.dli_fbase));
+    return where;
+}
+
+bool dump_profile(const string &path) {
+    if (g_perf_page == nullptr) {
+        return false;
+    }
+    drain_profiler();
+
+    ofstream fout(path.c_str(), ios::trunc);
+    if (!fout.is_open()) {
+        return false;
+    }
+
+    map<uint64_t, string> names;
+    for (size_t s = 0; s < g_stacks.size(); s++) {
+        if (g_stacks[s].depth == 0) {
+            continue;
+        }
+        const uint64_t *stack = &g_frames[g_stacks[s].first];
+        string line;
+        for (size_t i = g_stacks[s].depth; i-- > 0;) {
+            //a return address points after its call; step back into the call itself
+            uint64_t ip = i == 0 ? stack[i] : stack[i] - 1;
+            map<uint64_t, string>::iterator n = names.find(ip);
+            if (n == names.end()) {
+                n = names.insert(make_pair(ip, frame_name(ip))).first;
+            }
+            line += n->second;
+            line += i == 0 ? " " : ";";
+        }
+        fout << line << g_stacks[s].count << "\n";
+    }
+    if (g_lost > 0) {
+        fout << "[lost samples] " << g_lost << "\n";
+    }
+    if (g_dropped > 0) {
+        fout << "[dropped stacks] " << g_dropped << "\n";
+    }
+    return fout.good();
+}
@@ -0,0 +1,68 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <string>
+using namespace std;
+
+//samples per second of user CPU time; workers spend most of theirs in
+//the kernel, so this is high, and odd so it doesn't beat with timers
+const int PROFILE_HZ = 997;
+
+//data pages in the kernel's sample buffer (power of two), a few seconds
+//of busy CPU at PROFILE_HZ before samples are lost if nobody drains it
+const int PROFILE_PAGES = 64;
+
+//distinct call stacks counted, and innermost frames kept of each; room
+//for both is set aside by start_profiler so draining never allocates.
+//Samples of stacks that don't fit are counted as dropped
+const int PROFILE_MAX_STACKS = 4096;
+const int PROFILE_MAX_DEPTH  = 64;
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  start_profiler                                      */
+/* Description:    Starts sampling the calling thread's user-space     */
+/*                 call stacks with perf_event_open, on CPU time, and  */
+/*                 sets aside room for PROFILE_MAX_STACKS stacks.      */
+/*                 Stacks need frame pointers: build with              */
+/*                 -fno-omit-frame-pointer.                            */
+/* Parameters:     none                                                */
+/* Return Value:   bool – false if perf events are not available,      */
+/*                 e.g. kernel.perf_event_paranoid is too strict       */
+/*                                                                     */
+/***********************************************************************/
+
+bool start_profiler();
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  drain_profiler                                      */
+/* Description:    Moves new samples out of the kernel's buffer into   */
+/*                 per-stack counts. Cheap when there are none, and    */
+/*                 never allocates, so it can run between commands;    */
+/*                 call it often enough that the buffer does not fill. */
+/* Parameters:     none                                                */
+/* Return Value:   void – no return value                              */
+/*                                                                     */
+/***********************************************************************/
+
+void drain_profiler();
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  dump_profile                                        */
+/* Description:    Writes the counts so far as folded stacks, one      */
+/*                 "outer;...;inner count" line per stack, ready for   */
+/*                 flamegraph.pl or speedscope. Frames are function    */
+/*                 names where the dynamic symbol table has them       */
+/*                 (link with -rdynamic), otherwise offsets into the   */
+/*                 binary for addr2line.                               */
+/* Parameters:     const string &path: output file – input             */
+/* Return Value:   bool – false if the profiler is off or the file     */
+/*                 could not be written                                */
+/*                                                                     */
+/***********************************************************************/
+
+bool dump_profile(const string &path);
+
+#endif
@@ -0,0 +1,151 @@
+/************************************************************/
+/* Filename: ratelimit.cpp */
+/* Purpose: per-address token buckets shared by all server workers. */
+/************************************************************/
+
+#include "ratelimit.h"
+#include <ctime>
+
+using namespace std;
+
+// Milli-tokens in one token
+const uint64_t MILLI = 1000;
+
+// A stamp this far ahead of now is another worker's later clock read, not
+// a stamp from 49 days ago
+const uint32_t CLOCK_SKEW_MS = 1000;
+
+// Coarse clock: a few ns to read, and a few ms of resolution is plenty here
+static uint32_t rate_clock_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000);
+}
+
+static uint64_t pack_bucket(uint64_t milli, uint32_t ms) {
+    return (milli << 32) | ms;
+}
+
+// Milli-tokens in a bucket at time now, and the stamp that goes with them.
+// Another worker may have stamped a later now than ours; never go backwards
+static uint64_t refill(uint64_t state, uint32_t rate, uint32_t burst,
+                       uint32_t now, uint32_t &stamp) {
+    uint64_t milli = state >> 32;
+    stamp = (uint32_t)state;
+    //unsigned, so a bucket left alone for weeks refills instead of going negative
+    uint32_t elapsed = now - stamp;
+    if (elapsed != 0 && elapsed < 0u - CLOCK_SKEW_MS) {
+        milli += (uint64_t)elapsed * rate;  //rate per second is rate milli-tokens per ms
+        stamp  = now;
+    }
+    if (milli > (uint64_t)burst * MILLI) {
+        milli = (uint64_t)burst * MILLI;
+    }
+    return milli;
+}
+
+// Idle means both buckets have filled up again, so forgetting it loses nothing
+static bool entry_idle(const RateTable &table, const RateEntry &e, uint32_t now) {
+    for (int k = 0; k < 2; k++) {
+        uint32_t stamp;
+        if (table.rate[k] != 0 &&
+            refill(e.bucket[k].load(memory_order_relaxed), table.rate[k],
+                   table.burst[k], now, stamp) < (uint64_t)table.burst[k] * MILLI) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Takes one token with a compare-and-swap, retrying if another worker got in first
+static bool take_token(RateTable &table, RateEntry &e, int kind, uint32_t now) {
+    atomic<uint64_t> &bucket = e.bucket[kind];
+    uint64_t old = bucket.load(memory_order_relaxed);
+    while (true) {
+        uint32_t stamp;
+        uint64_t milli = refill(old, table.rate[kind], table.burst[kind], now, stamp);
+        if (milli < MILLI) {
+            table.rejected[kind].fetch_add(1, memory_order_relaxed);
+            return false;
+        }
+        if (bucket.compare_exchange_weak(old, pack_bucket(milli - MILLI, stamp),
+                                         memory_order_relaxed)) {
+            return true;
+        }
+    }
+}
+
+void init_rate_table(RateTable &table, uint32_t connect_rate, uint32_t command_rate) {
+    //above this a full bucket no longer fits pack_bucket's 32 bits
+    if (connect_rate > MAX_RATE) {
+        connect_rate = MAX_RATE;
+    }
+    if (command_rate > MAX_RATE) {
+        command_rate = MAX_RATE;
+    }
+    table.rate[RATE_CONNECT]  = connect_rate;
+    table.rate[RATE_COMMAND]  = command_rate;
+    table.burst[RATE_CONNECT] = connect_rate * RATE_BURST;
+    table.burst[RATE_COMMAND] = command_rate * RATE_BURST;
+    table.rejected[RATE_CONNECT].store(0);
+    table.rejected[RATE_COMMAND].store(0);
+    table.untracked.store(0);
+    for (int i = 0; i < RATE_TABLE_SIZE; i++) {
+        table.entries[i].ip.store(0);
+        table.entries[i].bucket[RATE_CONNECT].store(0);
+        table.entries[i].bucket[RATE_COMMAND].store(0);
+    }
+}
+
+// Finds or claims the address's slot, then charges it
+bool rate_allow(RateTable &table, uint32_t ip, int kind) {
+    if (table.rate[kind] == 0) {
+        return true;
+    }
+    uint32_t now  = rate_clock_ms();
+    uint32_t hash = (ip * 2654435761u) >> (32 - RATE_TABLE_BITS);
+
+    RateEntry *slot = nullptr;      //first free or idle slot seen
+    uint32_t slot_ip = 0;
+    for (int i = 0; i < RATE_PROBE; i++) {
+        RateEntry &e = table.entries[(hash + i) & (RATE_TABLE_SIZE - 1)];
+        uint32_t cur = e.ip.load(memory_order_acquire);
+        if (cur == ip) {
+            return take_token(table, e, kind, now);
+        }
+        if (cur == 0) {
+            if (slot == nullptr) {
+                slot    = &e;
+                slot_ip = 0;
+            }
+            break;      //slots are reused, never emptied, so ip is not further on
+        }
+        if (slot == nullptr && entry_idle(table, e, now)) {
+            slot    = &e;
+            slot_ip = cur;
+        }
+    }
+
+    if (slot == nullptr) {
+        table.untracked.fetch_add(1, memory_order_relaxed);
+        return true;
+    }
+
+    //claim the slot first; only the thread that wins it fills the buckets
+    uint64_t seen[2] = {slot->bucket[RATE_CONNECT].load(memory_order_relaxed),
+                        slot->bucket[RATE_COMMAND].load(memory_order_relaxed)};
+    if (!slot->ip.compare_exchange_strong(slot_ip, ip, memory_order_acq_rel)) {
+        if (slot_ip == ip) {
+            return take_token(table, *slot, kind, now);    //same address got there first
+        }
+        //another address won the slot; let this one through rather than search again
+        table.untracked.fetch_add(1, memory_order_relaxed);
+        return true;
+    }
+    //a bucket someone charged since the claim is already live; leave it be
+    for (int k = 0; k < 2; k++) {
+        slot->bucket[k].compare_exchange_strong(
+            seen[k], pack_bucket((uint64_t)table.burst[k] * MILLI, now), memory_order_relaxed);
+    }
+    return take_token(table, *slot, kind, now);
+}
@@ -0,0 +1,81 @@
+#ifndef RATELIMIT_H
+#define RATELIMIT_H
+
+#include <atomic>
+#include <cstdint>
+using namespace std;
+
+//what a token is spent on
+const int RATE_CONNECT = 0;
+const int RATE_COMMAND = 1;
+
+//default limits per client address, in tokens per second; a bucket holds
+//RATE_BURST seconds' worth so a short burst is not punished
+const uint32_t DEFAULT_CONNECT_RATE = 10;
+const uint32_t DEFAULT_COMMAND_RATE = 50;
+const uint32_t RATE_BURST           = 2;
+
+//highest rate accepted; a full bucket, in milli-tokens, must fit the
+//32 bits it gets in a packed bucket word
+const uint32_t MAX_RATE = 1000000;
+
+//open addressing over a fixed table; an address is looked for in
+//RATE_PROBE slots from its hash and nowhere else
+const int RATE_TABLE_BITS = 12;
+const int RATE_TABLE_SIZE = 1 << RATE_TABLE_BITS;
+const int RATE_PROBE      = 8;
+
+//one client address and its two token buckets. A bucket is packed into
+//one word, milli-tokens in the high half and the millisecond it was last
+//refilled in the low half, so taking a token is a single compare-and-swap
+struct alignas(32) RateEntry {
+    atomic<uint32_t> ip;            //IPv4 address, network order; 0 if free
+    atomic<uint64_t> bucket[2];     //indexed by RATE_CONNECT / RATE_COMMAND
+};
+
+//lives in shared memory so every worker charges the same buckets
+struct RateTable {
+    uint32_t rate[2];               //tokens per second, 0 for no limit
+    uint32_t burst[2];              //bucket size in tokens
+    alignas(64) atomic<uint64_t> rejected[2];
+    atomic<uint64_t> untracked;     //allowed because the probe window was full
+    alignas(64) RateEntry entries[RATE_TABLE_SIZE];
+};
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  init_rate_table                                     */
+/* Description:    Empties the table, clears the rejection counts and  */
+/*                 sets the limits, cutting any above MAX_RATE down to */
+/*                 it. Call before any worker uses it.                 */
+/* Parameters:     RateTable &table: table to set up – output          */
+/*                 uint32_t connect_rate: connections per second per   */
+/*                 address, 0 for no limit – input                     */
+/*                 uint32_t command_rate: commands per second per      */
+/*                 address, 0 for no limit – input                     */
+/* Return Value:   void – no return value                              */
+/*                                                                     */
+/***********************************************************************/
+
+void init_rate_table(RateTable &table, uint32_t connect_rate, uint32_t command_rate);
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  rate_allow                                          */
+/* Description:    Takes one token from an address's bucket, topping   */
+/*                 the bucket up first for the time since it was last  */
+/*                 used. Lock-free; safe from any process sharing the  */
+/*                 table. An address idle long enough for both its     */
+/*                 buckets to be full again gives up its slot to a new */
+/*                 one. If no slot is free near its hash the address   */
+/*                 is let through and counted as untracked.            */
+/* Parameters:     RateTable &table: shared table – input/output       */
+/*                 uint32_t ip: IPv4 address, network order – input    */
+/*                 int kind: RATE_CONNECT or RATE_COMMAND – input      */
+/* Return Value:   bool – true if allowed, false if over the limit     */
+/*                                                                     */
+/***********************************************************************/
+
+bool rate_allow(RateTable &table, uint32_t ip, int kind);
+
+#endif
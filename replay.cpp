@@ -0,0 +1,338 @@
+/***********************************************************************
+ * Filename:   replay.cpp
+ *
+ * Compile:    g++ replay.cpp library.cpp trace.cpp -o replay -pthread
+ * Run:        ./replay <trace-file> [port] [speed]
+ *             //speed is 1 (real time, default), N (N times faster)
+ *             //or max (no waiting between commands)
+ *
+ * Purpose:    Replays a trace recorded with ./server --capture against
+ *             a server on localhost and reports latency, throughput and
+ *             a checksum of the replies. With the server started with
+ *             the same --seed, the checksum is the same on every run.
+ ***********************************************************************/
+
+
+#include "library.h"
+#include "trace.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+
+const int DEFAULT_PORT = 5000;
+
+//FNV-1a, 64 bit
+const uint64_t FNV_OFFSET = 1469598103934665603ULL;
+const uint64_t FNV_PRIME  = 1099511628211ULL;
+
+//results gathered from every session thread
+struct ReplayResults {
+    mutex              lock;
+    condition_variable turn;            //signalled as each session gets its HELLO
+    size_t             connected;       //sessions through their connect, in trace order
+    vector<uint64_t>   latencies_us;    //one per command that gets a reply
+    vector<uint64_t>   checksums;       //each session's replies, in order
+    int                failed_sessions;
+};
+
+
+
+/**********************************************************************
+ * Function: expects_reply
+ * Purpose:  Tell whether the server answers a command line.
+ *
+ * Parameters:
+ *   line - const string&; the command as recorded.
+ *
+ * Returns:
+ *   bool - true for READY, WORD, GUESS and REMAINING.
+ *
+ **********************************************************************/
+bool expects_reply(const string &line) {
+    string_view cmd = trim_whitespace(line);
+    cmd = cmd.substr(0, cmd.find(' '));
+    return cmd == "READY" || cmd == "WORD" || cmd == "GUESS" || cmd == "REMAINING";
+}
+
+
+
+/**********************************************************************
+ * Function: hash_bytes / hash_number
+ * Purpose:  Feed bytes, or a number's 8 bytes, into a running FNV-1a
+ *           hash. Each step depends on the ones before it, so the same
+ *           input in a different order, or repeated, hashes
+ *           differently.
+ *
+ * Parameters:
+ *   h    - uint64_t; the hash so far.
+ *   text - string_view; bytes to add.
+ *   v    - uint64_t; number to add.
+ *
+ * Returns:
+ *   uint64_t - the hash with the input added.
+ *
+ **********************************************************************/
+uint64_t hash_bytes(uint64_t h, string_view text) {
+    for (size_t i = 0; i < text.size(); i++) {
+        h = (h ^ (uint8_t)text[i]) * FNV_PRIME;
+    }
+    return h;
+}
+
+uint64_t hash_number(uint64_t h, uint64_t v) {
+    for (int i = 0; i < 8; i++) {
+        h = (h ^ (uint8_t)(v >> (8 * i))) * FNV_PRIME;
+    }
+    return h;
+}
+
+
+
+/**********************************************************************
+ * Function: wait_turn / end_turn
+ * Purpose:  Let sessions connect one at a time in trace order: each
+ *           waits for the one before it to get its HELLO. The server
+ *           numbers connections in the order it greets them, so each
+ *           session gets the same number, and with --seed the same
+ *           words, on every run.
+ *
+ * Parameters:
+ *   number  - size_t; the session's position in the trace.
+ *   results - ReplayResults*; holds whose turn it is.
+ *
+ * Returns:
+ *   NULL
+ *
+ **********************************************************************/
+void wait_turn(size_t number, ReplayResults *results) {
+    unique_lock<mutex> guard(results->lock);
+    results->turn.wait(guard, [&]() { return results->connected == number; });
+}
+
+void end_turn(ReplayResults *results) {
+    lock_guard<mutex> guard(results->lock);
+    results->connected++;
+    results->turn.notify_all();
+}
+
+
+
+/**********************************************************************
+ * Function: replay_session
+ * Purpose:  Replay one recorded connection: connect once the session
+ *           before it has, then send each command at its recorded time
+ *           divided by speed, timing the reply to each.
+ *
+ * Parameters:
+ *   ts       - const TraceSession&; the recorded connection.
+ *   number   - size_t; its position in the trace.
+ *   port     - int; server port on localhost.
+ *   speed    - double; time scale, 0 for as fast as possible.
+ *   start_us - uint64_t; trace_clock_us() when the replay began.
+ *   base_us  - uint64_t; trace time of the first connection.
+ *   results  - ReplayResults*; where latencies and checksums go.
+ *
+ * Returns:
+ *   NULL
+ *
+ **********************************************************************/
+void replay_session(const TraceSession &ts, size_t number, int port, double speed,
+                    uint64_t start_us, uint64_t base_us, ReplayResults *results) {
+    vector<uint64_t> latencies;
+    uint64_t checksum = hash_number(FNV_OFFSET, number);
+    bool failed = false;
+    bool turn_taken = false;
+
+    int sockfd = -1;
+    LineReader reader;
+    init_line_reader(reader);
+
+    for (size_t i = 0; i < ts.events.size() && !failed; i++) {
+        const TraceEvent &ev = ts.events[i];
+
+        //wait for the event's place in the (scaled) timeline
+        if (speed > 0) {
+            uint64_t due = start_us + (uint64_t)((double)(ev.at_us - base_us) / speed);
+            uint64_t now = trace_clock_us();
+            if (due > now) {
+                usleep((useconds_t)(due - now));
+            }
+        }
+
+        if (ev.op == OP_CONNECT) {
+            wait_turn(number, results);
+            turn_taken = true;
+
+            struct sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_port   = htons(port);
+            inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+
+            //no Nagle: a command with no reply must not hold back the next one
+            string_view hello;
+            int one = 1;
+            sockfd = socket(AF_INET, SOCK_STREAM, 0);
+            if (sockfd != -1) {
+                setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            }
+            if (sockfd == -1 ||
+                connect(sockfd, (struct sockaddr*)&addr, sizeof(addr)) == -1 ||
+                !receive_line(sockfd, reader, hello)) {
+                failed = true;
+            }
+            end_turn(results);
+        } else if (ev.op == OP_COMMAND) {
+            uint64_t sent_us = trace_clock_us();
+            if (!send_message(sockfd, ev.line)) {
+                failed = true;
+                break;
+            }
+            if (expects_reply(ev.line)) {
+                string_view reply;
+                if (!receive_line(sockfd, reader, reply)) {
+                    failed = true;
+                    break;
+                }
+                latencies.push_back(trace_clock_us() - sent_us);
+                checksum = hash_number(checksum, i);
+                checksum = hash_bytes(checksum, reply);
+            }
+        } else if (ev.op == OP_CLOSE) {
+            break;
+        }
+    }
+    close_connection(sockfd);
+
+    //never connected: don't hold up the sessions after this one
+    if (!turn_taken) {
+        wait_turn(number, results);
+        end_turn(results);
+    }
+
+    lock_guard<mutex> guard(results->lock);
+    results->latencies_us.insert(results->latencies_us.end(), latencies.begin(), latencies.end());
+    results->checksums[number] = checksum;
+    if (failed) {
+        results->failed_sessions++;
+    }
+}
+
+
+
+/**********************************************************************
+ * Function: percentile
+ * Purpose:  Value at a percentile of a sorted list.
+ *
+ * Parameters:
+ *   sorted - const vector<uint64_t>&; values in ascending order.
+ *   p      - double; percentile, 0 to 100.
+ *
+ * Returns:
+ *   uint64_t - the value, or 0 if the list is empty.
+ *
+ **********************************************************************/
+uint64_t percentile(const vector<uint64_t> &sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t idx = (size_t)(p / 100.0 * (double)(sorted.size() - 1));
+    return sorted[idx];
+}
+
+
+
+
+
+int main(int argc, char *argv[]) {
+    if (argc < 2 || argc > 4) {
+        cout << "Usage: " << argv[0] << " <trace-file> [port] [speed|max]\n";
+        return 1;
+    }
+
+    int port = DEFAULT_PORT;
+    if (argc >= 3) {
+        port = atoi(argv[2]);
+        if (port <= 0 || port > 65535) {
+            cout << "Invalid port number.\n";
+            return 1;
+        }
+    }
+
+    double speed = 1.0;     //0 means as fast as possible
+    if (argc == 4) {
+        if (strcmp(argv[3], "max") == 0) {
+            speed = 0;
+        } else {
+            speed = atof(argv[3]);
+            if (speed <= 0) {
+                cout << "Speed must be a positive number or 'max'.\n";
+                return 1;
+            }
+        }
+    }
+
+    vector<TraceSession> sessions;
+    if (!load_trace(argv[1], sessions)) {
+        cout << "Could not read trace file '" << argv[1] << "'.\n";
+        return 1;
+    }
+    if (sessions.empty()) {
+        cout << "Trace has no sessions.\n";
+        return 1;
+    }
+
+    cout << "Replaying " << sessions.size() << " sessions at "
+         << (speed > 0 ? to_string(speed) + "x" : string("max speed")) << "...\n";
+
+    //one thread per recorded connection, so overlapping sessions overlap again
+    ReplayResults results;
+    results.connected       = 0;
+    results.checksums.assign(sessions.size(), 0);
+    results.failed_sessions = 0;
+
+    uint64_t base_us  = sessions[0].events[0].at_us;
+    uint64_t start_us = trace_clock_us();
+    vector<thread> threads;
+    for (size_t i = 0; i < sessions.size(); i++) {
+        threads.push_back(thread(replay_session, cref(sessions[i]), i, port, speed,
+                                 start_us, base_us, &results));
+    }
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+    double elapsed = (double)(trace_clock_us() - start_us) / 1e6;
+
+    //sessions in trace order, so swapping two sessions' replies shows
+    uint64_t checksum = FNV_OFFSET;
+    for (size_t i = 0; i < results.checksums.size(); i++) {
+        checksum = hash_number(checksum, results.checksums[i]);
+    }
+
+    vector<uint64_t> &lat = results.latencies_us;
+    sort(lat.begin(), lat.end());
+
+    cout << "Commands answered: " << lat.size() << " in " << elapsed << " s ("
+         << (elapsed > 0 ? (double)lat.size() / elapsed : 0) << " per second)\n";
+    cout << "Latency us: p50 " << percentile(lat, 50)
+         << "  p90 " << percentile(lat, 90)
+         << "  p99 " << percentile(lat, 99)
+         << "  max " << (lat.empty() ? 0 : lat.back()) << "\n";
+    cout << "Failed sessions: " << results.failed_sessions << "\n";
+    cout << "Reply checksum: " << hex << checksum << dec << "\n";
+    return results.failed_sessions == 0 ? 0 : 1;
+}
@@ -10,8 +10,37 @@
  * Assignment: Group 4 Project Application: Wordle
  * Filename:   server.cpp
  *
- * Compile:    g++ server.cpp library.cpp -o server
- * Run:        ./server [port]		//Defaul port is 5000
+ * Compile:    g++ server.cpp library.cpp game.cpp shared.cpp trace.cpp ratelimit.cpp \
+ *                 difficulty.cpp profile.cpp -o server
+ *             //for --profile add -fno-omit-frame-pointer -rdynamic
+ * Run:        ./server [port] [workers]	//Defaul port is 5000, 4 workers
+ *             ./server [port] [workers] --upgrade
+ *                               takes over the listening socket from
+ *                               the server running on that port
+ *             ./server [port] [workers] --capture <file> --seed <n>
+ *                               records every command for ./replay and
+ *                               makes word choices repeatable
+ *             ./server [port] [workers] --connect-rate <n> --command-rate <n>
+ *                               per-address limits per second,
+ *                               0 turns a limit off
+ *             ./server [port] [workers] --pin-cpus
+ *                               pins each worker to its own core
+ *             ./server [port] [workers] --spans --profile
+ *                               times each stage of every command and
+ *                               samples worker call stacks
+ *             ./server [port] [workers] --idle-timeout <s>
+ *                               closes a connection that sends nothing
+ *                               for s seconds (default 300, 0 = never)
+ *             ./server [port] [workers] --flush-us <n> --tcp <mode>
+ *                               replies to pipelined commands wait up
+ *                               to n microseconds to go out together
+ *                               (0 = never); mode is nagle, nodelay
+ *                               (default) or cork
+ *             kill -HUP <pid>   reloads words.txt for new games
+ *             kill -USR1 <pid>  prints stats summed over all workers
+ *             kill -USR2 <pid>  each worker writes spans-<pid>.json and
+ *                               profile-<pid>.folded
+ *             kill -TERM <pid>  stops accepting, lets games finish, exits
  *
  * Purpose:    Server Implementation
  ***********************************************************************/
@@ -19,134 +48,1178 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <vector>
+#include <atomic>
+#include <new>
+#include <charconv>
 #include <cstdlib>      
 #include <cstring>
 #include <unistd.h>     
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <signal.h>
 #include <sys/wait.h>   
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sched.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <ctime>
 #include <errno.h>      
 
 #include "library.h"
+#include "game.h"
+#include "shared.h"
+#include "trace.h"
+#include "ratelimit.h"
+#include "difficulty.h"
+#include "profile.h"
 
 using namespace std;
 
 const int DEFAULT_PORT = 5000;
 const string WORD_FILE = "words.txt";
+const string WORD_INDEX = "words.idx";   //difficulty scores, made by ./analyze
+
+//pool sizing: never fewer than the configured minimum, and keep between
+//MIN_SPARE and MAX_SPARE idle workers ready for new connections
+const int DEFAULT_WORKERS   = 4;
+const int MIN_SPARE_WORKERS = 1;
+const int MAX_SPARE_WORKERS = 4;
+
+//seconds a draining server waits for running games before killing them
+const int DRAIN_TIMEOUT = 30;
+
+//seconds a connection may send nothing, or take none of our replies,
+//before it is closed so it stops holding a worker; 0 waits forever
+const int DEFAULT_IDLE_TIMEOUT = 300;
+int g_idle_timeout = DEFAULT_IDLE_TIMEOUT;
+
+//shared with every forked worker; set once before the first fork
+SharedSegment *g_shm = nullptr;
+
+//set by signal handlers, acted on by the supervisor
+volatile sig_atomic_t g_reload_requested   = 0;
+volatile sig_atomic_t g_stats_requested    = 0;
+volatile sig_atomic_t g_shutdown_requested = 0;
+volatile sig_atomic_t g_worker_crashes     = 0;
+
+//SIGUSR2: the supervisor passes it on to the workers, a worker dumps its
+//spans and profile at its next command or within a second when idle
+volatile sig_atomic_t g_dump_requested = 0;
+
+//worker side of draining: the connection being served, whether a game
+//is running on it, and the listening socket and epoll set this worker
+//accepts from, all read by the worker's SIGTERM handler
+volatile sig_atomic_t g_draining  = 0;
+volatile sig_atomic_t g_client_fd = -1;
+volatile sig_atomic_t g_in_game   = 0;
+volatile sig_atomic_t g_listen_fd = -1;
+volatile sig_atomic_t g_epoll_fd  = -1;
+
+//guesses a game allows unless READY says otherwise with ATTEMPTS=<n>
+const size_t DEFAULT_ATTEMPTS = 6;
+
+//results of find_words
+const int WORDS_OK        = 0;
+const int WORDS_NO_LENGTH = 1;  //no words of that length, or no such length
+const int WORDS_NO_TIERS  = 2;  //a tier was asked for but the bank has no scores
+
+//every heap allocation this process makes, so the stats can show the
+//command path in handle_client makes none once a game is running
+atomic<uint64_t> g_heap_allocs(0);
+
+void *operator new(size_t n) {
+    g_heap_allocs.fetch_add(1, memory_order_relaxed);
+    void *p = malloc(n != 0 ? n : 1);
+    if (p == nullptr) {
+        throw bad_alloc();
+    }
+    return p;
+}
+
+//stable_sort's scratch buffer comes from here; without it a sanitizer's
+//allocator hands out memory that our delete then frees with free()
+void *operator new(size_t n, const nothrow_t &) noexcept {
+    g_heap_allocs.fetch_add(1, memory_order_relaxed);
+    return malloc(n != 0 ? n : 1);
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+//capture and seeding options, set in main before the workers are forked
+int      g_trace_fd    = -1;
+uint64_t g_trace_start = 0;
+bool     g_seeded      = false;
+uint64_t g_seed        = 0;
+
+//scratch space for building one reply; the arena is reset after every command
+const size_t ARENA_SIZE = 256;
+
+//everything one connection needs. A worker serves one connection at a
+//time, so it builds one of these when it starts and reuses it for every
+//connection, and a new connection doesn't allocate
+struct ClientSession {
+    LineReader  reader;
+    ReplyBuffer replies;
+    TraceWriter trace;
+    GameSession game;
+    char        arena_buf[ARENA_SIZE];
+};
+
+//how accepted sockets send small replies: Nagle's algorithm (the kernel
+//default), TCP_NODELAY, or TCP_CORK lifted after every batch of replies
+const int TCP_MODE_NAGLE   = 0;
+const int TCP_MODE_NODELAY = 1;
+const int TCP_MODE_CORK    = 2;
+
+//replies wait this long at most for the commands already received
+//behind them, then go out together; 0 sends each reply as it is made.
+//A client waiting for its reply never waits on this
+const uint64_t DEFAULT_FLUSH_US = 200;
+
+int      g_tcp_mode = TCP_MODE_NODELAY;
+uint64_t g_flush_us = DEFAULT_FLUSH_US;
+
+//with --pin-cpus each worker stays on one core, so its session stays on
+//that core's NUMA node
+bool g_pin_cpus = false;
+
+//--spans and --profile, turned on in each worker as it starts
+bool g_spans_option   = false;
+bool g_profile_option = false;
+bool g_profiling      = false;
+
+
+/**********************************************************************
+ * Function: sigchld_handler
+ * Purpose:  handler to prevent zombie processes when children exit.
+ *
+ * Parameters:
+ *   s - int; the signal number
+ *
+ * Returns:
+ *   NULL
+ *
+ **********************************************************************/
+void sigchld_handler(int s) {
+    (void)s; //quiet unused variable warning
+    int saved_errno = errno;
+    pid_t pid;
+    int status;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        //reap all finished children, freeing stats slots of any that crashed
+        if (g_shm != nullptr) {
+            release_worker_stats(g_shm, pid);
+        }
+        if (WIFSIGNALED(status) || (WIFEXITED(status) && WEXITSTATUS(status) != 0)) {
+            g_worker_crashes = g_worker_crashes + 1;
+        }
+    }
+    errno = saved_errno;
+}
+
+
+
+/**********************************************************************
+ * Function: sigflag_handler
+ * Purpose:  handler for SIGHUP (reload the word bank), SIGUSR1 (print
+ *           stats), SIGUSR2 (dump spans and profile) and SIGTERM (shut
+ *           down); only sets a flag for the supervisor, or for a
+ *           worker in the case of SIGUSR2.
+ *
+ * Parameters:
+ *   s - int; the signal number
+ *
+ * Returns:
+ *   NULL
+ *
+ **********************************************************************/
+void sigflag_handler(int s) {
+    if (s == SIGHUP) {
+        g_reload_requested = 1;
+    } else if (s == SIGUSR1) {
+        g_stats_requested = 1;
+    } else if (s == SIGUSR2) {
+        g_dump_requested = 1;
+    } else if (s == SIGTERM) {
+        g_shutdown_requested = 1;
+    }
+}
+
+
+
+/**********************************************************************
+ * Function: worker_sigterm_handler
+ * Purpose:  SIGTERM in a worker: stop taking connections, closing
+ *           this worker's copy of the listening socket so the kernel
+ *           stops queueing clients on it once every copy is gone. A
+ *           client between games is cut off right away by shutting
+ *           down the read side of its socket; one in a game may
+ *           finish it.
+ *
+ * Parameters:
+ *   s - int; the signal number
+ *
+ * Returns:
+ *   NULL
+ *
+ **********************************************************************/
+void worker_sigterm_handler(int s) {
+    (void)s; //quiet unused variable warning
+    g_draining = 1;
+    //the supervisor, or the server taking over, holds its own copy
+    if (g_listen_fd >= 0) {
+        epoll_ctl(g_epoll_fd, EPOLL_CTL_DEL, g_listen_fd, nullptr);
+        close(g_listen_fd);
+        g_listen_fd = -1;
+    }
+    if (g_client_fd >= 0 && !g_in_game) {
+        shutdown(g_client_fd, SHUT_RD);     //wakes a blocked recv with end of file
+    }
+}
+
+
+
+/**********************************************************************
+ * Function: reload_word_bank
+ * Purpose:  Re-read the word file and publish it to all workers
+ *           through shared memory. Games already running keep the
+ *           bank they started with.
+ *
+ * Parameters:
+ *   shm - SharedSegment*; the segment shared with the workers.
+ *
+ * Returns:
+ *   NULL
+ *
+ **********************************************************************/
+void reload_word_bank(SharedSegment *shm) {
+    WordBank word_bank;
+    if (!load_word_bank(WORD_FILE, word_bank)) {
+        cerr << "Reload failed: could not load words from " << WORD_FILE << endl;
+        return;
+    }
+    if (!load_difficulty_index(WORD_INDEX, word_bank)) {
+        cerr << "No up-to-date " << WORD_INDEX << "; difficulty tiers are off until "
+             << "./analyze is run." << endl;
+    }
+    if (!publish_word_bank(shm, word_bank)) {
+        cerr << "Reload failed: bank too large or previous reload still in use." << endl;
+        return;
+    }
+    cout << "Reloaded " << WORD_FILE << " (generation "
+         << shm->generation.load() << ")." << endl;
+    log_event("Word bank reloaded.");
+}
+
+
+
+/**********************************************************************
+ * Function: print_stats
+ * Purpose:  Sum every worker's counters from shared memory and print
+ *           them.
+ *
+ * Parameters:
+ *   shm - const SharedSegment*; the segment shared with the workers.
+ *
+ * Returns:
+ *   NULL
+ *
+ **********************************************************************/
+void print_stats(const SharedSegment *shm) {
+    StatsTotals t;
+    sum_stats(shm, t);
+    cout << "Stats: " << t.live_workers << " live workers ("
+         << t.busy_workers << " busy), "
+         << t.connections << " connections, "
+         << t.commands << " commands, "
+         << t.games << " games, "
+         << t.guesses << " guesses, "
+         << t.errors << " errors, "
+         << t.allocations << " heap allocations while serving, "
+         << t.rejected_connections << " connections and "
+         << t.rejected_commands << " commands rate limited ("
+         << t.untracked << " untracked), word bank generation "
+         << t.generation << "." << endl;
+}
+
+
+
+/**********************************************************************
+ * Function: forward_dump
+ * Purpose:  Pass a SIGUSR2 on to every live worker.
+ *
+ * Parameters:
+ *   shm - const SharedSegment*; the segment shared with the workers.
+ *
+ * Returns:
+ *   NULL
+ *
+ **********************************************************************/
+void forward_dump(const SharedSegment *shm) {
+    for (int i = 0; i < MAX_WORKERS; i++) {
+        pid_t pid = (pid_t)shm->workers[i].pid.load();
+        if (pid > 0) {
+            kill(pid, SIGUSR2);
+        }
+    }
+}
+
+
+
+/**********************************************************************
+ * Function: dump_diagnostics
+ * Purpose:  Worker side of SIGUSR2: write this worker's spans and
+ *           profile, if they are on, to files named by its pid.
+ *
+ * Parameters:
+ *   none
+ *
+ * Returns:
+ *   NULL
+ *
+ **********************************************************************/
+void dump_diagnostics() {
+    g_dump_requested = 0;
+    char path[64];
+    if (g_spans_enabled) {
+        snprintf(path, sizeof(path), "spans-%d.json", (int)getpid());
+        if (dump_spans(path)) {
+            cout << "Wrote " << path << endl;
+        }
+    }
+    if (g_profiling) {
+        snprintf(path, sizeof(path), "profile-%d.folded", (int)getpid());
+        if (dump_profile(path)) {
+            cout << "Wrote " << path << endl;
+        }
+    }
+}
+
+
+
+/**********************************************************************
+ * Function: split_command
+ * Purpose:  Split a client message into the command word and its
+ *           argument, e.g. "READY 6" -> "READY", "6".
+ *
+ * Parameters:
+ *   msg  - string_view; trimmed message from the client.
+ *   cmd  - string_view&; the command word (output).
+ *   arg  - string_view&; everything after the first space, trimmed
+ *          (output). Both point into msg.
+ *
+ * Returns:
+ *   NULL
+ *
+ **********************************************************************/
+void split_command(string_view msg, string_view &cmd, string_view &arg) {
+    size_t space = msg.find(' ');
+    if (space == string_view::npos) {
+        cmd = msg;
+        arg = string_view();
+        return;
+    }
+    cmd = msg.substr(0, space);
+    arg = trim_whitespace(msg.substr(space + 1));
+}
+
+
+
+/**********************************************************************
+ * Function: set_tcp_mode
+ * Purpose:  Apply the --tcp mode to a newly accepted connection.
+ *
+ * Parameters:
+ *   sock - int; the connected client socket file descriptor.
+ *
+ * Returns:
+ *   NULL
+ *
+ **********************************************************************/
+void set_tcp_mode(int sock) {
+    //corked needs NODELAY too: lifting the cork only pushes past Nagle with it
+    int one = 1;
+    if (g_tcp_mode == TCP_MODE_NODELAY || g_tcp_mode == TCP_MODE_CORK) {
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    if (g_tcp_mode == TCP_MODE_CORK) {
+        setsockopt(sock, IPPROTO_TCP, TCP_CORK, &one, sizeof(one));
+    }
+}
+
+/**********************************************************************
+ * Function: set_idle_timeout
+ * Purpose:  Give a newly accepted connection the --idle-timeout
+ *           deadline on every receive and send, so a silent client
+ *           can't hold its worker forever.
+ *
+ * Parameters:
+ *   sock - int; the connected client socket file descriptor.
+ *
+ * Returns:
+ *   NULL
+ *
+ **********************************************************************/
+void set_idle_timeout(int sock) {
+    if (g_idle_timeout <= 0) {
+        return;
+    }
+    struct timeval tv;
+    tv.tv_sec  = g_idle_timeout;
+    tv.tv_usec = 0;
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+/**********************************************************************
+ * Function: push_replies
+ * Purpose:  Send the replies queued for a client. With --tcp cork,
+ *           lift the cork and put it back, so the kernel sends the
+ *           last partial packet now instead of holding it.
+ *
+ * Parameters:
+ *   sock    - int; the connected client socket file descriptor.
+ *   replies - ReplyBuffer&; the connection's queued replies
+ *             (input/output).
+ *
+ * Returns:
+ *   bool - false if the replies could not be sent.
+ *
+ **********************************************************************/
+bool push_replies(int sock, ReplyBuffer &replies) {
+    if (!flush_replies(sock, replies)) {
+        return false;
+    }
+    if (g_tcp_mode == TCP_MODE_CORK) {
+        int off = 0, on = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_CORK, &off, sizeof(off));
+        setsockopt(sock, IPPROTO_TCP, TCP_CORK, &on, sizeof(on));
+    }
+    return true;
+}
+
+/**********************************************************************
+ * Function: input_within
+ * Purpose:  Wait a little while for the client to send more, so
+ *           replies already queued can go out with the next ones.
+ *
+ * Parameters:
+ *   sock - int; the connected client socket file descriptor.
+ *   us   - uint64_t; longest wait, in microseconds.
+ *
+ * Returns:
+ *   bool - true if there is input (or a hang-up) to read now; false
+ *          if the wait ran out or a signal cut it short.
+ *
+ **********************************************************************/
+bool input_within(int sock, uint64_t us) {
+    struct pollfd pfd;
+    pfd.fd      = sock;
+    pfd.events  = POLLIN;
+    pfd.revents = 0;
+    struct timespec ts;
+    ts.tv_sec  = us / 1000000;
+    ts.tv_nsec = (long)(us % 1000000) * 1000;
+    return ppoll(&pfd, 1, &ts, nullptr) > 0;
+}
+
+
+
+/**********************************************************************
+ * Function: find_words
+ * Purpose:  Find the words a READY asks for in one bank slot: those of
+ *           its length and, if it names a tier, that tier's alias
+ *           table.
+ *
+ * Parameters:
+ *   shm        - const SharedSegment*; shared word bank.
+ *   slot       - int; bank slot to look in.
+ *   len        - size_t; word length asked for.
+ *   tier       - int; TIER_* asked for, or -1 for any word.
+ *   words      - const char*&; the packed words of that length
+ *                (output).
+ *   count      - size_t&; how many there are (output).
+ *   table      - const AliasEntry*&; the tier's alias table (output).
+ *   tier_count - size_t&; entries in the table (output).
+ *
+ * Returns:
+ *   int - WORDS_OK if a game can start from them, WORDS_NO_LENGTH or
+ *         WORDS_NO_TIERS if not.
+ *
+ **********************************************************************/
+int find_words(const SharedSegment *shm, int slot, size_t len, int tier, const char *&words,
+               size_t &count, const AliasEntry *&table, size_t &tier_count) {
+    count = 0;
+    if (is_supported_length(len)) {
+        words = bank_words(shm, slot, len, count);
+    }
+    if (count == 0) {
+        return WORDS_NO_LENGTH;
+    }
+    tier_count = 0;
+    if (tier != -1) {
+        table = bank_tier(shm, slot, len, tier, tier_count);
+        if (tier_count == 0) {
+            return WORDS_NO_TIERS;
+        }
+    }
+    return WORDS_OK;
+}
+
+
+
+/**********************************************************************
+ * Function: handle_client
+ * Purpose:  Handle all communication with client:
+ *           send "HELLO", respond to
+ *           "READY [len] [HARD] [TIER=easy|medium|hard] [ATTEMPTS=n]"
+ *           /"WORD ..." with a random word of that length (default 5),
+ *           from that difficulty tier if one is given, and start a
+ *           game of n guesses (default 6), score "GUESS <word>",
+ *           answer "REMAINING" with the
+ *           number of words still possible, and close the connection
+ *           on "BYE"/"QUIT". Replies are queued and sent before the
+ *           next wait for input, so commands that arrive together are
+ *           answered together: replies wait up to
+ *           --flush-us for the commands after them, even ones that
+ *           arrive in a later read, and go out when that runs out or
+ *           the buffer fills.
+ *
+ * Parameters:
+ *   client_sock - int; the connected client socket file descriptor.
+ *   shm         - SharedSegment*; shared word bank the server picks
+ *                 words from.
+ *   stats       - WorkerStats*; this worker's counters.
+ *   client_ip   - uint32_t; client's IPv4 address, network order, for
+ *                 the per-address command limit.
+ *   cs          - ClientSession*; the worker's buffers and game state,
+ *                 reused from its previous connection.
+ *
+ * Returns:
+ *   NULL. function runs until the client disconnects or sends
+ *   "BYE"/"QUIT" then closes the client socket.
+ *
+ **********************************************************************/
+void handle_client(int client_sock, SharedSegment *shm, WorkerStats *stats, uint32_t client_ip,
+                   ClientSession *cs) {
+    stats->connections.fetch_add(1, memory_order_relaxed);
+
+    ReplyBuffer &replies = cs->replies;
+    init_reply_buffer(replies);
+
+    //numbered before HELLO goes out, so a client that waits for HELLO
+    //before the next connect knows which number each connection got
+    uint64_t session = shm->next_session.fetch_add(1);
+
+    //send HELLO upon connection
+    if (!queue_reply(client_sock, replies, "HELLO") || !push_replies(client_sock, replies)) {
+        cout << "Error sending HELLO to client." << endl;
+        close_connection(client_sock);
+        return;
+    }
+
+    g_client_fd = client_sock;
+    g_in_game   = 0;
+
+    //with --seed the Nth connection always gets the same words
+    uint64_t rng = g_seeded ? g_seed + session
+                            : trace_clock_us() ^ ((uint64_t)getpid() << 32);
+
+    //the session keeps its memory between connections; reset what matters
+    TraceWriter &trace = cs->trace;
+    trace_begin(trace, g_trace_fd, session, g_trace_start);
+
+    LineReader &reader = cs->reader;
+    init_line_reader(reader);
+
+    Arena arena;
+    arena_init(arena, cs->arena_buf, sizeof(cs->arena_buf));
+
+    GameSession &game = cs->game;
+    bool have_game = false;     //a game was started; REMAINING can answer
+    bool in_game   = false;     //and it is not yet solved or out of guesses
+    size_t guesses_left = 0;
+    int bank_slot = -1;         //bank pinned by the current game
+
+    uint64_t alloc_mark = g_heap_allocs.load(memory_order_relaxed);
+    uint64_t command_span = 0;
+    uint64_t batch_us = 0;      //when the queued replies started waiting
+
+    bool running = true;
+    while (running) {
+        //close the previous command's span, then see to diagnostics between commands
+        span_end(SPAN_COMMAND, command_span);
+        command_span = 0;
+        if (g_dump_requested) {
+            dump_diagnostics();
+        }
+        if (g_profiling) {
+            drain_profiler();
+        }
+
+        //charge the previous command's heap allocations, then free its scratch
+        uint64_t allocs = g_heap_allocs.load(memory_order_relaxed);
+        stats->allocations.fetch_add(allocs - alloc_mark, memory_order_relaxed);
+        alloc_mark = allocs;
+        arena_reset(arena);
+
+        //send the replies queued so far, unless they have waited less than
+        //--flush-us and the next command is here, or arrives before then
+        if (replies.used > 0) {
+            bool hold = false;
+            if (g_flush_us > 0) {
+                uint64_t now = trace_clock_us();
+                if (batch_us == 0) {
+                    batch_us = now;
+                }
+                uint64_t waited = now - batch_us;
+                hold = waited < g_flush_us &&
+                       (line_pending(reader) || input_within(client_sock, g_flush_us - waited));
+            }
+            if (!hold) {
+                if (!push_replies(client_sock, replies)) {
+                    cout << "Error sending replies to client." << endl;
+                    break;
+                }
+                batch_us = 0;
+            }
+        }
+
+        //shutting down and no game running: nothing left to finish
+        if (g_draining && !in_game) {
+            cout << "Server draining. Closing idle session." << endl;
+            break;
+        }
+
+        //about to block: get the capture onto disk first, so a worker that
+        //dies waiting (killed at the drain timeout, say) loses no records
+        if (!line_pending(reader)) {
+            trace_sync(trace);
+        }
+
+        //wait for a message from the client
+        string_view msg;
+        errno = 0;
+        if (!receive_line(client_sock, reader, msg)) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                //nothing for --idle-timeout seconds; free the worker
+                queue_reply(client_sock, replies, "ERROR idle timeout");
+                cout << "Client idle too long. Closing session." << endl;
+                break;
+            }
+            cout << "Client disconnected or error receiving." << endl;
+            break;
+        }
+
+        command_span = span_begin();
+        uint64_t span = command_span;
+
+        trace_command(trace, msg);
+        msg = trim_whitespace(msg);
+        stats->commands.fetch_add(1, memory_order_relaxed);
+
+        string_view cmd, arg;
+        split_command(msg, cmd, arg);
+        span_end(SPAN_PARSE, span);
+
+        //over its command rate: say so and drop the command, but always let it leave
+        if (cmd != "BYE" && cmd != "QUIT" && !rate_allow(shm->limits, client_ip, RATE_COMMAND)) {
+            if (!queue_reply(client_sock, replies, "ERROR too many commands, slow down")) {
+                break;
+            }
+            continue;
+        }
+
+        if ((cmd == "READY" || cmd == "WORD") && g_draining) {
+            //the last game is over; don't start another on a server going away
+            queue_reply(client_sock, replies, "BYE");
+            cout << "Server draining. Closing session after its game." << endl;
+            running = false;
+        }
+        else if (cmd == "READY" || cmd == "WORD") {
+            span = span_begin();
+
+            //length, HARD, TIER=<tier> and ATTEMPTS=<n> are optional and in
+            //any order; classic 5 letters and 6 guesses, any difficulty otherwise
+            size_t len      = DEFAULT_WORD_LEN;
+            size_t attempts = DEFAULT_ATTEMPTS;
+            bool hard  = false;
+            int tier   = -1;
+            string_view len_arg, bad_arg, token, rest = arg;
+            while (!rest.empty() && bad_arg.empty()) {
+                split_command(rest, token, rest);
+                if (token == "HARD") {
+                    hard = true;
+                } else if (token.substr(0, 5) == "TIER=") {
+                    tier = parse_tier(token.substr(5));
+                    if (tier == -1) {
+                        bad_arg = token;
+                    }
+                } else if (token.substr(0, 9) == "ATTEMPTS=") {
+                    string_view n = token.substr(9);
+                    from_chars_result fc = from_chars(n.data(), n.data() + n.size(), attempts);
+                    if (fc.ec != errc() || fc.ptr != n.data() + n.size() || attempts == 0) {
+                        bad_arg = token;
+                    }
+                } else if (parse_tier(token) != -1) {
+                    bad_arg = token;    //a bare "hard" reads too much like HARD
+                } else if (!len_arg.empty()) {
+                    bad_arg = token;    //one length only: "5 6" is not a 6
+                } else {
+                    //the whole token must be the number: "5x" is no length at all
+                    len_arg = token;
+                    const char *end = len_arg.data() + len_arg.size();
+                    from_chars_result fc = from_chars(len_arg.data(), end, len);
+                    if (fc.ec != errc() || fc.ptr != end) {
+                        bad_arg = token;
+                    }
+                }
+            }
+            if (!bad_arg.empty()) {
+                stats->errors.fetch_add(1, memory_order_relaxed);
+                string_view reply = arena_format(arena, "ERROR bad argument %.*s, send READY "
+                                                 "[length] [HARD] [TIER=easy|medium|hard] "
+                                                 "[ATTEMPTS=n]",
+                                                 (int)bad_arg.size(), bad_arg.data());
+                if (!queue_reply(client_sock, replies, reply)) {
+                    break;
+                }
+                continue;
+            }
+
+            //look in the bank a new game would get before giving up the
+            //running one, so a READY that can't be served leaves it playable
+            const char *words = nullptr;
+            const AliasEntry *table = nullptr;
+            size_t count = 0, tier_count = 0;
+            int found = find_words(shm, peek_bank(shm), len, tier, words, count,
+                                   table, tier_count);
+            if (found == WORDS_OK) {
+                //the previous game is over, pin whichever bank is current now
+                if (bank_slot != -1) {
+                    release_bank(shm, stats, bank_slot);
+                }
+                bank_slot = acquire_bank(shm, stats);
+                have_game = false;
+                in_game   = false;
+                g_in_game = 0;
+
+                //a reload between the look and the pin may have changed the bank
+                found = find_words(shm, bank_slot, len, tier, words, count, table, tier_count);
+            }
+            if (found == WORDS_NO_LENGTH) {
+                stats->errors.fetch_add(1, memory_order_relaxed);
+                string_view reply = arena_format(arena, "ERROR no words of length %zu", len);
+                if (!queue_reply(client_sock, replies, reply)) {
+                    break;
+                }
+                cout << "No words of length " << len << " for client." << endl;
+                continue;
+            }
+            if (found == WORDS_NO_TIERS) {
+                stats->errors.fetch_add(1, memory_order_relaxed);
+                if (!queue_reply(client_sock, replies, "ERROR no difficulty scores, run ./analyze")) {
+                    break;
+                }
+                continue;
+            }
+
+            //a tier is drawn from its alias table, otherwise any word is equally likely
+            size_t pick = tier == -1 ? (size_t)(next_random(rng) % count)
+                                     : sample_alias(table, tier_count, rng);
+
+            //send the word straight from the shared bank
+            string_view random_word(words + pick * len, len);
+            span_end(SPAN_SELECT, span);
+            if (!queue_reply(client_sock, replies, random_word)) {
+                cout << "Error sending word to client." << endl;
+                break;
+            }
+            cout << "Sent word '" << random_word << "' to client." << endl;
+
+            start_game(game, words, count, random_word, hard);
+            have_game    = true;
+            in_game      = true;
+            g_in_game    = 1;
+            guesses_left = attempts;
+            stats->games.fetch_add(1, memory_order_relaxed);
+        }
+        else if (cmd == "GUESS") {
+            string_view reply;
+            if (!in_game) {
+                reply = have_game ? "ERROR game over, send READY for a new word"
+                                  : "ERROR no game, send READY first";
+            } else {
+                //lowercase copy in the arena; play_guess rejects bad lengths. One
+                //longer than any word gets no copy, leaving room for the reply
+                char *guess = arg.size() <= MAX_WORD_LEN ? arena_alloc(arena, arg.size())
+                                                         : nullptr;
+                for (size_t i = 0; guess != nullptr && i < arg.size(); i++) {
+                    guess[i] = (char)tolower((unsigned char)arg[i]);
+                }
+
+                char *pattern = arena_alloc(arena, MAX_WORD_LEN);
+                int result = GUESS_INVALID;
+                if (guess != nullptr && pattern != nullptr) {
+                    span = span_begin();
+                    result = play_guess(game, string_view(guess, arg.size()), pattern);
+                    span_end(SPAN_SCORE, span);
+                }
+                if (result == GUESS_OK) {
+                    reply = string_view(pattern, game.len);
+                    stats->guesses.fetch_add(1, memory_order_relaxed);
+
+                    //solved or out of guesses: the game is over, so a
+                    //draining worker need not wait on this client
+                    if (--guesses_left == 0 || reply.find_first_not_of('+') == string_view::npos) {
+                        in_game   = false;
+                        g_in_game = 0;
+                    }
+                } else if (result == GUESS_INCONSISTENT) {
+                    reply = "REJECT guess must use all earlier hints";
+                } else {
+                    reply = arena_format(arena, "REJECT guess must be %zu letters", game.len);
+                }
+            }
+            if (!queue_reply(client_sock, replies, reply)) {
+                cout << "Error sending guess result to client." << endl;
+                break;
+            }
+        }
+        else if (cmd == "REMAINING") {
+            string_view reply = "ERROR no game, send READY first";
+            if (have_game) {
+                reply = arena_format(arena, "%zu", game.remaining);
+            }
+            if (!queue_reply(client_sock, replies, reply)) {
+                cout << "Error sending remaining count to client." << endl;
+                break;
+            }
+        }
+        else if (cmd == "BYE" || cmd == "QUIT") {
+            //handle BYE/QUIT
+            cout << "Client sent BYE/QUIT. Closing session." << endl;
+            running = false;
+        }
+        else {
+            stats->errors.fetch_add(1, memory_order_relaxed);
+            cout << "Unknown message from client: '" << msg << "'" << endl;
+        }
+    }
+
+    span_end(SPAN_COMMAND, command_span);
+    push_replies(client_sock, replies);     //a closing BYE, or answers before a hang-up
+    stats->allocations.fetch_add(g_heap_allocs.load(memory_order_relaxed) - alloc_mark,
+                                 memory_order_relaxed);
+    if (bank_slot != -1) {
+        release_bank(shm, stats, bank_slot);
+    }
+    trace_end(trace);
+    g_client_fd = -1;
+    close_connection(client_sock);
+}
+
+/**********************************************************************
+ * Function: pin_worker
+ * Purpose:  Keep this worker on one CPU, chosen from the CPUs the
+ *           server may run on by the worker's stats slot, so workers
+ *           spread over the cores.
+ *
+ * Parameters:
+ *   slot - int; the worker's stats slot number.
+ *
+ * Returns:
+ *   NULL
+ *
+ **********************************************************************/
+void pin_worker(int slot) {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1 || CPU_COUNT(&allowed) == 0) {
+        perror("sched_getaffinity");
+        return;
+    }
+
+    //the (slot mod count)th allowed CPU
+    int skip = slot % CPU_COUNT(&allowed);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed) && skip-- == 0) {
+            cpu_set_t one;
+            CPU_ZERO(&one);
+            CPU_SET(cpu, &one);
+            if (sched_setaffinity(0, sizeof(one), &one) == -1) {
+                perror("sched_setaffinity");
+            }
+            return;
+        }
+    }
+}
+
+
+
+/**********************************************************************
+ * Function: map_session
+ * Purpose:  Build the session a worker reuses for every connection, in
+ *           memory it faults in itself: under Linux's first-touch
+ *           policy the pages land on the NUMA node of the calling
+ *           worker, so pin it first to keep them local.
+ *
+ * Parameters:
+ *   none
+ *
+ * Returns:
+ *   ClientSession* - the session, or nullptr if it could not be mapped.
+ *
+ **********************************************************************/
+ClientSession *map_session() {
+    void *mem = mmap(nullptr, sizeof(ClientSession), PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (mem == MAP_FAILED) {
+        return nullptr;
+    }
+    return new (mem) ClientSession();
+}
+
+
+
+/**********************************************************************
+ * Function: worker_main
+ * Purpose:  Body of one pre-forked worker: wait for connections on the
+ *           shared listening socket and serve them one after another
+ *           until the supervisor asks this worker to retire. The
+ *           session they share is built here, after any pinning, so
+ *           its memory is local to the worker's core.
+ *
+ * Parameters:
+ *   listen_fd - int; the shared, non-blocking listening socket.
+ *   stats     - WorkerStats*; this worker's slot in shared memory.
+ *
+ * Returns:
+ *   NULL
+ *
+ **********************************************************************/
+void worker_main(int listen_fd, WorkerStats *stats) {
+    //SIGTERM drains this worker instead of killing it
+    struct sigaction st;
+    st.sa_handler = worker_sigterm_handler;
+    sigemptyset(&st.sa_mask);
+    st.sa_flags = 0;
+    sigaction(SIGTERM, &st, nullptr);
+    signal(SIGHUP, SIG_IGN);
+    signal(SIGUSR1, SIG_IGN);
+    g_dump_requested = 0;               //SIGUSR2 keeps sigflag_handler: dump on request
+
+    prctl(PR_SET_PDEATHSIG, SIGTERM);   //don't outlive the supervisor
+    protect_word_bank(g_shm);
+
+    if (g_pin_cpus) {
+        pin_worker((int)(stats - g_shm->workers));
+    }
+    ClientSession *cs = map_session();
+    if (cs == nullptr) {
+        perror("session");
+        exit(1);
+    }
+
+    //diagnostics are per worker; each keeps its own span ring and samples
+    if (g_spans_option && !enable_spans()) {
+        cerr << "Could not allocate span ring; spans are off." << endl;
+    }
+    if (g_profile_option) {
+        g_profiling = start_profiler();
+    }
+
+    //EPOLLEXCLUSIVE wakes one waiting worker per connection, not all of them
+    int epfd = epoll_create1(0);
+    g_epoll_fd = epfd;
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events  = EPOLLIN | EPOLLEXCLUSIVE;
+    ev.data.fd = listen_fd;
+    if (epfd == -1 || epoll_ctl(epfd, EPOLL_CTL_ADD, listen_fd, &ev) == -1) {
+        perror("epoll");
+        exit(1);
+    }
+    g_listen_fd = listen_fd;    //SIGTERM closes it from here on
+
+    while (!stats->retire.load() && !g_draining) {
+        if (g_dump_requested) {
+            dump_diagnostics();
+        }
+        if (g_profiling) {
+            drain_profiler();
+        }
+
+        struct epoll_event ready;
+        if (epoll_wait(epfd, &ready, 1, 1000) <= 0 || g_draining) {
+            continue;   //timeout or signal: check retire and draining again
+        }
+
+        struct sockaddr_in client_addr;
+        socklen_t sin_size = sizeof(client_addr);
+        int new_fd = accept(listen_fd, (struct sockaddr*)&client_addr, &sin_size);
+        if (new_fd == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                perror("Accept failed");
+            }
+            continue;
+        }
+
+        //turn away a host opening connections too fast before it ties up this worker
+        if (!rate_allow(g_shm->limits, client_addr.sin_addr.s_addr, RATE_CONNECT)) {
+            send_message(new_fd, "ERROR too many connections, try again later");
+            close_connection(new_fd);
+            cout << "Rate limited connection from "
+                 << inet_ntoa(client_addr.sin_addr) << endl;
+            continue;
+        }
+
+        cout << "Received connection from "
+             << inet_ntoa(client_addr.sin_addr) << endl;
+
+        set_tcp_mode(new_fd);
+        set_idle_timeout(new_fd);
+        stats->busy.store(1);
+        handle_client(new_fd, g_shm, stats, client_addr.sin_addr.s_addr, cs);
+        stats->busy.store(0);
+    }
+
+    close(epfd);
+
+    //leave the last spans and samples behind when retiring or shutting down
+    if (g_spans_enabled || g_profiling) {
+        dump_diagnostics();
+    }
+}
+
 
 
 /**********************************************************************
- * Function: sigchld_handler
- * Purpose:  handler to prevent zombie processes when children exit.
+ * Function: spawn_worker
+ * Purpose:  Reserve a stats slot and fork one worker into it.
  *
  * Parameters:
- *   s - int; the signal number
+ *   listen_fd - int; the shared listening socket.
  *
  * Returns:
- *   NULL
+ *   pid_t - the worker's pid, or -1 if the pool is full or fork failed.
  *
  **********************************************************************/
-void sigchld_handler(int s) {
-    (void)s; //quiet unused variable warning
-    int saved_errno = errno;
-    while (waitpid(-1, nullptr, WNOHANG) > 0) {
-        //reap all finished children
+pid_t spawn_worker(int listen_fd) {
+    //hold SIGCHLD so the reaper can't run before the slot has the child's pid
+    sigset_t block, old;
+    sigemptyset(&block);
+    sigaddset(&block, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &block, &old);
+
+    WorkerStats *stats = claim_worker_stats(g_shm, PID_RESERVED);
+    if (stats == &g_shm->workers[MAX_WORKERS]) {
+        sigprocmask(SIG_SETMASK, &old, nullptr);
+        return -1;  //only the overflow slot is left
     }
-    errno = saved_errno;
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        sigprocmask(SIG_SETMASK, &old, nullptr);
+        worker_main(listen_fd, stats);
+        exit(0);
+    }
+
+    if (pid < 0) {
+        perror("fork");
+        stats->pid.store(0);
+    } else {
+        stats->pid.store((int32_t)pid);
+    }
+    sigprocmask(SIG_SETMASK, &old, nullptr);
+    return pid;
 }
 
 
 
 /**********************************************************************
- * Function: handle_client
- * Purpose:  Handle all communication with client:
- *           send "HELLO", respond to "READY"/"WORD" with a random word,
- *           and close the connection on "BYE"/"QUIT".
+ * Function: retire_idle_worker
+ * Purpose:  Ask one idle worker to exit once it next wakes up.
  *
  * Parameters:
- *   client_sock - int; the connected client socket file descriptor.
- *   word_bank   - const vector<string>&; list of valid words the server
- *                 can send to the client.
+ *   shm - SharedSegment*; the segment shared with the workers.
  *
  * Returns:
- *   NULL. function runs until the client disconnects or sends
- *   "BYE"/"QUIT" then closes the client socket.
+ *   NULL
  *
  **********************************************************************/
-void handle_client(int client_sock, const vector<string>& word_bank) {
-    //send HELLO upon connection
-    if (!send_message(client_sock, "HELLO")) {
-        cout << "Error sending HELLO to client." << endl;
-        close_connection(client_sock);
-        return;
+void retire_idle_worker(SharedSegment *shm) {
+    for (int i = 0; i < MAX_WORKERS; i++) {
+        WorkerStats &w = shm->workers[i];
+        if (w.pid.load() > 0 && !w.busy.load() && !w.retire.load()) {
+            w.retire.store(1);
+            return;
+        }
     }
+}
 
-    bool running = true;
-    while (running) {
-        string msg;
-
-        //wait for a message from the client
-        if (!receive_message(client_sock, msg)) {
-            cout << "Client disconnected or error receiving." << endl;
-            break;
-        }
 
-        msg = trim_whitespace(msg);
 
-        if (msg == "READY" || msg == "WORD") {
-            //select random word and send it
-            string random_word = get_random_word(word_bank);
-            if (!send_message(client_sock, random_word)) {
-                cout << "Error sending word to client." << endl;
-                break;
-            }
-            cout << "Sent word '" << random_word << "' to client." << endl;
-        }
-        else if (msg == "BYE" || msg == "QUIT") {
-            //handle BYE/QUIT
-            cout << "Client sent BYE/QUIT. Closing session." << endl;
-            running = false;
-        }
-        else {
-            cout << "Unknown message from client: '" << msg << "'" << endl;
-        }
+/**********************************************************************
+ * Function: turn_away_connections
+ * Purpose:  With every worker busy and the pool at MAX_WORKERS, accept
+ *           whatever is waiting on the listening socket and answer
+ *           "REJECT busy", so those clients hear at once instead of
+ *           sitting in the accept queue.
+ *
+ * Parameters:
+ *   listen_fd - int; the shared, non-blocking listening socket.
+ *
+ * Returns:
+ *   NULL
+ *
+ **********************************************************************/
+void turn_away_connections(int listen_fd) {
+    int turned_away = 0;
+    int fd;
+    while ((fd = accept(listen_fd, nullptr, nullptr)) != -1) {
+        send_message(fd, "REJECT busy");
+        close_connection(fd);
+        turned_away++;
+    }
+    if (turned_away > 0) {
+        cout << "Pool full, turned away " << turned_away << " connection(s)." << endl;
     }
-
-    close_connection(client_sock);
 }
 
-int main(int argc, char *argv[]) {
-    //load word bank
-    vector<string> word_bank;
-    if (!load_words(WORD_FILE, word_bank)) {
-        cerr << "Error: Could not load words from " << WORD_FILE << endl;
-        return 1;
-    }
-    if (word_bank.empty()) {
-        cerr << "Error: Word bank is empty." << endl;
-        return 1;
-    }
-    cout << "Loaded " << word_bank.size() << " words." << endl;
 
-    //port
-    int port = DEFAULT_PORT;
-    if (argc == 2) {
-        port = atoi(argv[1]);
-        if (port <= 0 || port > 65535) {
-            cerr << "Invalid port. Using default " << DEFAULT_PORT << endl;
-            port = DEFAULT_PORT;
-        }
-    }
 
+/**********************************************************************
+ * Function: open_listener
+ * Purpose:  Create, bind and listen on the server's TCP socket.
+ *
+ * Parameters:
+ *   port - int; TCP port to listen on.
+ *
+ * Returns:
+ *   int - the non-blocking listening socket, or -1 on error.
+ *
+ **********************************************************************/
+int open_listener(int port) {
     //create listening socket
     int sockfd = socket(AF_INET, SOCK_STREAM, 0);
     if (sockfd < 0) {
         perror("Socket creation failed");
-        return 1;
+        return -1;
     }
 
     //allow port reuse
@@ -166,15 +1239,440 @@ int main(int argc, char *argv[]) {
     if (bind(sockfd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
         perror("Bind failed");
         close(sockfd);
-        return 1;
+        return -1;
     }
 
-    //listen
-    if (listen(sockfd, 10) < 0) {
+    //listen; connections wait in the backlog while every worker is busy
+    if (listen(sockfd, SOMAXCONN) < 0) {
         perror("Listen failed");
         close(sockfd);
+        return -1;
+    }
+
+    //non-blocking so a worker that loses the race to accept just goes back to waiting
+    fcntl(sockfd, F_SETFL, fcntl(sockfd, F_GETFL, 0) | O_NONBLOCK);
+
+    return sockfd;
+}
+
+
+
+/**********************************************************************
+ * Function: control_socket_path
+ * Purpose:  Name of the Unix socket a new server connects to when it
+ *           takes over from the one running on the same port.
+ *
+ * Parameters:
+ *   port - int; TCP port the server listens on.
+ *
+ * Returns:
+ *   string - path of the control socket, in the working directory.
+ *
+ **********************************************************************/
+string control_socket_path(int port) {
+    return "server-" + to_string(port) + ".sock";
+}
+
+
+
+/**********************************************************************
+ * Function: open_control_socket
+ * Purpose:  Listen on the control socket for an upgrading server.
+ *
+ * Parameters:
+ *   path - const string&; path from control_socket_path.
+ *
+ * Returns:
+ *   int - listening Unix socket, or -1 on error (upgrades disabled).
+ *
+ **********************************************************************/
+int open_control_socket(const string &path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+        perror("control socket");
+        return -1;
+    }
+
+    //we already own the TCP port, so any file left here is from a dead server
+    unlink(path.c_str());
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1 || listen(fd, 1) == -1) {
+        perror("control socket");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+
+
+/**********************************************************************
+ * Function: take_over_listener
+ * Purpose:  Upgrade mode: ask the running server for its listening
+ *           socket. The old server stops accepting and drains once it
+ *           has sent it, so connections are never refused.
+ *
+ * Parameters:
+ *   path - const string&; the old server's control socket.
+ *
+ * Returns:
+ *   int - the listening socket, or -1 on error.
+ *
+ **********************************************************************/
+int take_over_listener(const string &path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+        perror("connect to running server");
+        if (fd != -1) {
+            close(fd);
+        }
+        return -1;
+    }
+
+    int listen_fd = receive_fd(fd);
+
+    //the old server closes only after unlinking its path, so ours can take it
+    char byte;
+    while (recv(fd, &byte, 1, 0) > 0) {
+    }
+    close(fd);
+    return listen_fd;
+}
+
+
+
+/**********************************************************************
+ * Function: hand_over_listener
+ * Purpose:  Accept an upgrading server on the control socket and pass
+ *           it the listening socket.
+ *
+ * Parameters:
+ *   ctrl_fd   - int; listening control socket.
+ *   listen_fd - int; the TCP listening socket to pass on.
+ *   path      - const string&; control socket path, given up here.
+ *
+ * Returns:
+ *   bool - true if the new server has the socket; this one should
+ *          now drain.
+ *
+ **********************************************************************/
+bool hand_over_listener(int ctrl_fd, int listen_fd, const string &path) {
+    int conn = accept(ctrl_fd, nullptr, nullptr);
+    if (conn == -1) {
+        return false;
+    }
+
+    unlink(path.c_str());
+    bool sent = send_fd(conn, listen_fd);
+    close(conn);
+    if (!sent) {
+        perror("send listening socket");
+        return false;
+    }
+    return true;
+}
+
+
+
+/**********************************************************************
+ * Function: drain_workers
+ * Purpose:  Tell every worker to stop accepting and finish its game,
+ *           then wait up to DRAIN_TIMEOUT seconds before killing any
+ *           that are still running.
+ *
+ * Parameters:
+ *   shm - SharedSegment*; the segment shared with the workers.
+ *
+ * Returns:
+ *   NULL
+ *
+ **********************************************************************/
+void drain_workers(SharedSegment *shm) {
+    for (int i = 0; i < MAX_WORKERS; i++) {
+        pid_t pid = shm->workers[i].pid.load();
+        if (pid > 0) {
+            kill(pid, SIGTERM);
+        }
+    }
+
+    time_t deadline = time(NULL) + DRAIN_TIMEOUT;
+    StatsTotals t;
+    sum_stats(shm, t);
+    while (t.live_workers > 0 && time(NULL) < deadline) {
+        cout << "Waiting for " << t.live_workers << " worker(s) to finish..." << endl;
+        sleep(1);   //cut short when a worker exits
+        sum_stats(shm, t);
+    }
+
+    if (t.live_workers > 0) {
+        cout << "Drain timed out, stopping " << t.live_workers << " worker(s)." << endl;
+        for (int i = 0; i < MAX_WORKERS; i++) {
+            pid_t pid = shm->workers[i].pid.load();
+            if (pid > 0) {
+                kill(pid, SIGKILL);
+            }
+        }
+    }
+}
+
+
+
+/**********************************************************************
+ * Function: parse_rate
+ * Purpose:  Read a --connect-rate or --command-rate value, falling
+ *           back to the default on anything but a plain number and
+ *           capping it at MAX_RATE.
+ *
+ * Parameters:
+ *   text     - const char*; the option's value.
+ *   option   - const char*; the option's name, for messages.
+ *   fallback - uint32_t; the default rate.
+ *
+ * Returns:
+ *   uint32_t - tokens per second, 0 for no limit.
+ *
+ **********************************************************************/
+uint32_t parse_rate(const char *text, const char *option, uint32_t fallback) {
+    uint32_t rate = 0;
+    const char *end = text + strlen(text);
+    from_chars_result fc = from_chars(text, end, rate);
+    if (fc.ec == errc::invalid_argument || fc.ptr != end) {
+        cerr << "Invalid " << option << ". Using default " << fallback << endl;
+        return fallback;
+    }
+    if (fc.ec == errc::result_out_of_range || rate > MAX_RATE) {
+        cerr << option << " too high. Using " << MAX_RATE << endl;
+        return MAX_RATE;
+    }
+    return rate;
+}
+
+
+
+/**********************************************************************
+ * Function: supervise
+ * Purpose:  Keep the worker pool running: once a second, respawn
+ *           workers that died, grow the pool when too few are idle,
+ *           shrink it when too many are, and handle reload and stats
+ *           requests. When the pool can't grow and no worker is free,
+ *           new connections are turned away here. Returns on SIGTERM
+ *           or after handing the listening socket to an upgrading
+ *           server.
+ *
+ * Parameters:
+ *   listen_fd   - int; the shared listening socket.
+ *   min_workers - int; pool size to start with and never go under.
+ *   ctrl_fd     - int; control socket for upgrades, or -1.
+ *   ctrl_path   - const string&; path of the control socket.
+ *
+ * Returns:
+ *   bool - true if the listening socket was handed to a new server.
+ *
+ **********************************************************************/
+bool supervise(int listen_fd, int min_workers, int ctrl_fd, const string &ctrl_path) {
+    int crashes_seen = 0;
+
+    while (!g_shutdown_requested) {
+        if (g_reload_requested) {
+            g_reload_requested = 0;
+            reload_word_bank(g_shm);
+        }
+        if (g_stats_requested) {
+            g_stats_requested = 0;
+            print_stats(g_shm);
+        }
+        if (g_dump_requested) {
+            g_dump_requested = 0;
+            forward_dump(g_shm);
+        }
+        if (g_worker_crashes != crashes_seen) {
+            cout << (g_worker_crashes - crashes_seen)
+                 << " worker(s) exited abnormally, respawning." << endl;
+            crashes_seen = g_worker_crashes;
+        }
+
+        StatsTotals t;
+        sum_stats(g_shm, t);
+        int idle = t.live_workers - t.busy_workers;
+
+        //respawn up to the minimum, then keep some spare workers waiting
+        int wanted = 0;
+        if (t.live_workers < min_workers) {
+            wanted = min_workers - t.live_workers;
+        }
+        if (idle + wanted < MIN_SPARE_WORKERS) {
+            wanted = MIN_SPARE_WORKERS - idle;
+        }
+        for (int i = 0; i < wanted && t.live_workers + i < MAX_WORKERS; i++) {
+            spawn_worker(listen_fd);
+        }
+
+        //one at a time, so a short lull doesn't drain the pool
+        if (wanted == 0 && idle > MAX_SPARE_WORKERS && t.live_workers > min_workers) {
+            retire_idle_worker(g_shm);
+        }
+
+        //no worker will be free to accept; watch the queue ourselves
+        bool full = idle == 0 && t.live_workers >= MAX_WORKERS;
+
+        //wait a second for an upgrading server; cut short by any signal
+        struct pollfd pfd[2];
+        pfd[0].fd      = ctrl_fd;
+        pfd[0].events  = POLLIN;
+        pfd[0].revents = 0;
+        pfd[1].fd      = full ? listen_fd : -1;    //poll skips a negative fd
+        pfd[1].events  = POLLIN;
+        pfd[1].revents = 0;
+        if (poll(pfd, 2, 1000) <= 0) {
+            continue;
+        }
+        if (pfd[0].revents & POLLIN) {
+            if (hand_over_listener(ctrl_fd, listen_fd, ctrl_path)) {
+                cout << "Listening socket handed to new server." << endl;
+                return true;
+            }
+        }
+        if (pfd[1].revents & POLLIN) {
+            //a worker may have come free while we waited
+            sum_stats(g_shm, t);
+            if (t.busy_workers >= t.live_workers) {
+                turn_away_connections(listen_fd);
+            }
+        }
+    }
+    return false;
+}
+
+int main(int argc, char *argv[]) {
+    //options may come anywhere; the rest are positional
+    bool upgrade = false;
+    string capture_path;
+    uint32_t connect_rate = DEFAULT_CONNECT_RATE;
+    uint32_t command_rate = DEFAULT_COMMAND_RATE;
+    int nargs = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--upgrade") == 0) {
+            upgrade = true;
+        } else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+            capture_path = argv[++i];
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            g_seeded = true;
+            g_seed   = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--pin-cpus") == 0) {
+            g_pin_cpus = true;
+        } else if (strcmp(argv[i], "--spans") == 0) {
+            g_spans_option = true;
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            g_profile_option = true;
+        } else if (strcmp(argv[i], "--idle-timeout") == 0 && i + 1 < argc) {
+            g_idle_timeout = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--flush-us") == 0 && i + 1 < argc) {
+            g_flush_us = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--tcp") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "nagle") == 0) {
+                g_tcp_mode = TCP_MODE_NAGLE;
+            } else if (strcmp(argv[i], "nodelay") == 0) {
+                g_tcp_mode = TCP_MODE_NODELAY;
+            } else if (strcmp(argv[i], "cork") == 0) {
+                g_tcp_mode = TCP_MODE_CORK;
+            } else {
+                cerr << "Invalid --tcp mode. Using nodelay." << endl;
+            }
+        } else if (strcmp(argv[i], "--connect-rate") == 0 && i + 1 < argc) {
+            connect_rate = parse_rate(argv[++i], "--connect-rate", DEFAULT_CONNECT_RATE);
+        } else if (strcmp(argv[i], "--command-rate") == 0 && i + 1 < argc) {
+            command_rate = parse_rate(argv[++i], "--command-rate", DEFAULT_COMMAND_RATE);
+        } else {
+            argv[nargs++] = argv[i];
+        }
+    }
+    argc = nargs;
+
+    //a fresh file each run; every worker appends whole chunks of records to it
+    if (!capture_path.empty()) {
+        g_trace_fd = open_trace(capture_path);
+        if (g_trace_fd == -1) {
+            perror("capture file");
+            return 1;
+        }
+        g_trace_start = trace_clock_us();
+        cout << "Capturing commands to " << capture_path << "." << endl;
+    }
+
+    //load word bank
+    WordBank word_bank;
+    if (!load_word_bank(WORD_FILE, word_bank)) {
+        cerr << "Error: Could not load words from " << WORD_FILE << endl;
+        return 1;
+    }
+    for (size_t len = MIN_WORD_LEN; len <= MAX_WORD_LEN; len++) {
+        cout << "Loaded " << word_bank.by_length[len].size()
+             << " words of length " << len << "." << endl;
+    }
+    if (load_difficulty_index(WORD_INDEX, word_bank)) {
+        cout << "Loaded difficulty tiers from " << WORD_INDEX << "." << endl;
+    } else {
+        cout << "No up-to-date " << WORD_INDEX << "; run ./analyze to enable "
+             << "difficulty tiers." << endl;
+    }
+
+    //publish the bank to shared memory so every worker maps the same copy
+    g_shm = create_shared_segment(word_bank);
+    if (g_shm == nullptr) {
+        cerr << "Error: Could not create shared memory segment." << endl;
         return 1;
     }
+    init_rate_table(g_shm->limits, connect_rate, command_rate);
+
+    //port
+    int port = DEFAULT_PORT;
+    if (argc >= 2) {
+        port = atoi(argv[1]);
+        if (port <= 0 || port > 65535) {
+            cerr << "Invalid port. Using default " << DEFAULT_PORT << endl;
+            port = DEFAULT_PORT;
+        }
+    }
+
+    //minimum worker pool size
+    int min_workers = DEFAULT_WORKERS;
+    if (argc >= 3) {
+        min_workers = atoi(argv[2]);
+        if (min_workers <= 0 || min_workers > MAX_WORKERS) {
+            cerr << "Invalid worker count. Using default " << DEFAULT_WORKERS << endl;
+            min_workers = DEFAULT_WORKERS;
+        }
+    }
+
+    string ctrl_path = control_socket_path(port);
+    int sockfd = -1;
+
+    if (upgrade) {
+        //take the socket over from the running server instead of binding
+        sockfd = take_over_listener(ctrl_path);
+        if (sockfd < 0) {
+            cerr << "Error: Could not take over port " << port << "." << endl;
+            return 1;
+        }
+        cout << "Took over listening socket from running server." << endl;
+    } else {
+        sockfd = open_listener(port);
+        if (sockfd < 0) {
+            return 1;
+        }
+    }
+
+    int ctrl_fd = open_control_socket(ctrl_path);
 
     //reaper for dead child processes
     struct sigaction sa;
@@ -187,35 +1685,41 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    cout << "Server listening on port " << port << "..." << endl;
+    //a client that hangs up early is a failed send, not a dead process
+    signal(SIGPIPE, SIG_IGN);
 
-    //accept loop
-    while (true) {
-        struct sockaddr_in client_addr;
-        socklen_t sin_size = sizeof(client_addr);
-        int new_fd = accept(sockfd, (struct sockaddr*)&client_addr, &sin_size);
+    //reload, stats and shutdown requests; no SA_RESTART so the supervisor wakes up for them
+    struct sigaction sf;
+    sf.sa_handler = sigflag_handler;
+    sigemptyset(&sf.sa_mask);
+    sf.sa_flags = 0;
+    if (sigaction(SIGHUP, &sf, nullptr) == -1 || sigaction(SIGUSR1, &sf, nullptr) == -1 ||
+        sigaction(SIGUSR2, &sf, nullptr) == -1 || sigaction(SIGTERM, &sf, nullptr) == -1) {
+        perror("sigaction");
+        close(sockfd);
+        return 1;
+    }
 
-        if (new_fd == -1) {
-            perror("Accept failed");
-            continue;
-        }
+    cout << "Server listening on port " << port << " with "
+         << min_workers << " workers..." << endl;
 
-        cout << "Received connection from "
-             << inet_ntoa(client_addr.sin_addr) << endl;
+    //the workers accept; this process only keeps the pool running
+    bool handed_over = supervise(sockfd, min_workers, ctrl_fd, ctrl_path);
 
-        //fork for concurrency
-        pid_t pid = fork();
-        if (pid == 0) {
-            //child process
-            close(sockfd); //child doesn't need the listening socket
-            handle_client(new_fd, word_bank);
-            exit(0);
+    //stop accepting here; the socket stays open in the new server if there is one
+    close(sockfd);
+    if (ctrl_fd != -1) {
+        close(ctrl_fd);
+        if (!handed_over) {
+            unlink(ctrl_path.c_str());
         }
-
-        //parent process
-        close(new_fd); //parent doesn't use this client socket
     }
 
-    close(sockfd);
+    cout << "Shutting down, letting running games finish..." << endl;
+    drain_workers(g_shm);
+
+    log_event(handed_over ? "Server handed off to new process and exited."
+                          : "Server shut down.");
+    cout << "Server stopped." << endl;
     return 0;
 }
@@ -0,0 +1,268 @@
+/************************************************************/
+/* Filename: shared.cpp */
+/* Purpose: shared memory word bank and stats used by the server and its workers. */
+/************************************************************/
+
+#include "shared.h"
+#include <cstring>
+#include <cstdio>
+#include <new>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+const size_t MIN_SLOT_SIZE = 64 * 1024;
+
+// Rounds n up to a whole number of pages
+static size_t page_round(size_t n) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    return (n + page - 1) / page * page;
+}
+
+// Start of one bank slot inside the segment
+static BankSlot *slot_at(const SharedSegment *shm, int slot) {
+    char *base = (char *)shm;
+    return (BankSlot *)(base + shm->bank_offset + (size_t)slot * shm->slot_size);
+}
+
+// Letters end here; the alias tables start at the next aligned byte
+static size_t alias_start(size_t letters) {
+    return (letters + alignof(AliasEntry) - 1) / alignof(AliasEntry) * alignof(AliasEntry);
+}
+
+// Bytes the letters and alias tables of a bank need once packed
+static size_t packed_size(const WordBank &bank) {
+    size_t letters = 0;
+    size_t entries = 0;
+    for (size_t len = MIN_WORD_LEN; len <= MAX_WORD_LEN; len++) {
+        letters += bank.by_length[len].size() * len;
+        if (!bank.difficulty[len].empty()) {
+            for (int t = 0; t < NUM_TIERS; t++) {
+                entries += tier_size(bank.difficulty[len].size(), t);
+            }
+        }
+    }
+    return alias_start(letters) + entries * sizeof(AliasEntry);
+}
+
+// Packs bank into slot, false if it does not fit
+static bool pack_bank(SharedSegment *shm, int slot, const WordBank &bank) {
+    BankSlot *dst = slot_at(shm, slot);
+    size_t room = shm->slot_size - offsetof(BankSlot, letters);
+    if (packed_size(bank) > room) {
+        return false;
+    }
+
+    uint64_t pos = 0;
+    for (size_t len = 0; len <= MAX_WORD_LEN; len++) {
+        const vector<string> &words = bank.by_length[len];
+        dst->count[len]  = (uint32_t)words.size();
+        dst->offset[len] = pos;
+        for (size_t i = 0; i < words.size(); i++) {
+            memcpy(dst->letters + pos, words[i].data(), len);
+            pos += len;
+        }
+    }
+
+    //tier tables are built here, once per publish, so picking a word is O(1)
+    dst->alias_offset = alias_start(pos);
+    AliasEntry *tables = (AliasEntry *)(dst->letters + dst->alias_offset);
+    uint64_t entry = 0;
+    for (size_t len = 0; len <= MAX_WORD_LEN; len++) {
+        const vector<float> &difficulty = bank.difficulty[len];
+        for (int t = 0; t < NUM_TIERS; t++) {
+            dst->tier_offset[len][t] = entry;
+            dst->tier_count[len][t]  = 0;
+            if (difficulty.size() == bank.by_length[len].size() && !difficulty.empty()) {
+                build_tier_table(difficulty, t, tables + entry);
+                dst->tier_count[len][t] = (uint32_t)tier_size(difficulty.size(), t);
+                entry += dst->tier_count[len][t];
+            }
+        }
+    }
+    return true;
+}
+
+// Maps the segment and publishes the first bank into slot 0
+SharedSegment *create_shared_segment(const WordBank &bank) {
+    size_t header    = page_round(sizeof(SharedSegment));
+    size_t slot_size = page_round(offsetof(BankSlot, letters) + packed_size(bank) * 4);
+    if (slot_size < MIN_SLOT_SIZE) {
+        slot_size = MIN_SLOT_SIZE;  //leave room for the bank to grow on reload
+    }
+    size_t total = header + 2 * slot_size;
+
+    //the name is only needed until the mapping exists; fork() shares it after that
+    char name[64];
+    snprintf(name, sizeof(name), "/wordle-%d", (int)getpid());
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd == -1) {
+        perror("shm_open");
+        return nullptr;
+    }
+    shm_unlink(name);
+
+    if (ftruncate(fd, (off_t)total) == -1) {
+        perror("ftruncate");
+        close(fd);
+        return nullptr;
+    }
+
+    void *mem = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) {
+        perror("mmap");
+        return nullptr;
+    }
+
+    SharedSegment *shm = new (mem) SharedSegment;
+    shm->active.store(0);
+    shm->generation.store(1);
+    shm->readers[0].store(0);
+    shm->readers[1].store(0);
+    shm->next_session.store(0);
+    shm->total_size  = total;
+    shm->bank_offset = header;
+    shm->slot_size   = slot_size;
+    for (int i = 0; i <= MAX_WORKERS; i++) {
+        new (&shm->workers[i]) WorkerStats;
+        shm->workers[i].pid.store(0);
+        shm->workers[i].busy.store(0);
+        shm->workers[i].retire.store(0);
+        shm->workers[i].bank_pin.store(-1);
+        shm->workers[i].connections.store(0);
+        shm->workers[i].commands.store(0);
+        shm->workers[i].games.store(0);
+        shm->workers[i].guesses.store(0);
+        shm->workers[i].errors.store(0);
+        shm->workers[i].allocations.store(0);
+    }
+    init_rate_table(shm->limits, DEFAULT_CONNECT_RATE, DEFAULT_COMMAND_RATE);
+
+    if (!pack_bank(shm, 0, bank)) {
+        munmap(mem, total);
+        return nullptr;
+    }
+    return shm;
+}
+
+// Writes the spare slot then switches new games over to it
+bool publish_word_bank(SharedSegment *shm, const WordBank &bank) {
+    int spare = 1 - (int)shm->active.load();
+    if (shm->readers[spare].load() != 0) {
+        return false;   //games from the reload before this one are still running
+    }
+    if (!pack_bank(shm, spare, bank)) {
+        return false;
+    }
+    shm->active.store((uint32_t)spare);
+    shm->generation.fetch_add(1);
+    return true;
+}
+
+// Children never write the words, so map them read-only there
+void protect_word_bank(SharedSegment *shm) {
+    char *base = (char *)shm;
+    if (mprotect(base + shm->bank_offset, 2 * shm->slot_size, PROT_READ) == -1) {
+        perror("mprotect");
+    }
+}
+
+// Pins the active slot; re-checks after pinning in case a reload flipped it.
+// A kill between the count and the record leaks the pin rather than
+// dropping it twice
+int acquire_bank(SharedSegment *shm, WorkerStats *owner) {
+    while (true) {
+        int slot = (int)shm->active.load();
+        shm->readers[slot].fetch_add(1);
+        if ((int)shm->active.load() == slot) {
+            owner->bank_pin.store(slot);
+            return slot;
+        }
+        shm->readers[slot].fetch_sub(1);
+    }
+}
+
+void release_bank(SharedSegment *shm, WorkerStats *owner, int slot) {
+    owner->bank_pin.store(-1);
+    shm->readers[slot].fetch_sub(1);
+}
+
+int peek_bank(const SharedSegment *shm) {
+    return (int)shm->active.load();
+}
+
+// Words of one length in a pinned slot
+const char *bank_words(const SharedSegment *shm, int slot, size_t len, size_t &count) {
+    const BankSlot *src = slot_at(shm, slot);
+    count = src->count[len];
+    return src->letters + src->offset[len];
+}
+
+// Alias table of one tier in a pinned slot
+const AliasEntry *bank_tier(const SharedSegment *shm, int slot, size_t len, int tier,
+                            size_t &count) {
+    const BankSlot *src = slot_at(shm, slot);
+    const AliasEntry *tables = (const AliasEntry *)(src->letters + src->alias_offset);
+    count = src->tier_count[len][tier];
+    return tables + src->tier_offset[len][tier];
+}
+
+// First free stats slot, or the overflow slot shared by everyone else
+WorkerStats *claim_worker_stats(SharedSegment *shm, pid_t pid) {
+    for (int i = 0; i < MAX_WORKERS; i++) {
+        int32_t expected = 0;
+        if (shm->workers[i].pid.compare_exchange_strong(expected, (int32_t)pid)) {
+            shm->workers[i].busy.store(0);
+            shm->workers[i].retire.store(0);
+            shm->workers[i].bank_pin.store(-1);
+            return &shm->workers[i];
+        }
+    }
+    return &shm->workers[MAX_WORKERS];
+}
+
+// Safe to call from a signal handler. A worker killed mid-game never
+// released its bank, which would block every later reload
+void release_worker_stats(SharedSegment *shm, pid_t pid) {
+    for (int i = 0; i < MAX_WORKERS; i++) {
+        WorkerStats &w = shm->workers[i];
+        if (w.pid.load() != (int32_t)pid) {
+            continue;
+        }
+        int pin = w.bank_pin.exchange(-1);
+        if (pin != -1) {
+            shm->readers[pin].fetch_sub(1);
+        }
+        w.pid.store(0);     //last, so the slot is clean before it can be claimed again
+        return;
+    }
+}
+
+// Totals over every slot, including ones whose worker has exited
+void sum_stats(const SharedSegment *shm, StatsTotals &out) {
+    memset(&out, 0, sizeof(out));
+    for (int i = 0; i <= MAX_WORKERS; i++) {
+        const WorkerStats &w = shm->workers[i];
+        out.connections += w.connections.load(memory_order_relaxed);
+        out.commands    += w.commands.load(memory_order_relaxed);
+        out.games       += w.games.load(memory_order_relaxed);
+        out.guesses     += w.guesses.load(memory_order_relaxed);
+        out.errors      += w.errors.load(memory_order_relaxed);
+        out.allocations += w.allocations.load(memory_order_relaxed);
+        if (i < MAX_WORKERS && w.pid.load(memory_order_relaxed) != 0) {
+            out.live_workers++;
+            if (w.busy.load(memory_order_relaxed)) {
+                out.busy_workers++;
+            }
+        }
+    }
+    out.rejected_connections = shm->limits.rejected[RATE_CONNECT].load(memory_order_relaxed);
+    out.rejected_commands    = shm->limits.rejected[RATE_COMMAND].load(memory_order_relaxed);
+    out.untracked            = shm->limits.untracked.load(memory_order_relaxed);
+    out.generation = shm->generation.load();
+}
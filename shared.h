@@ -0,0 +1,211 @@
+#ifndef SHARED_H
+#define SHARED_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <sys/types.h>
+#include "library.h"
+#include "ratelimit.h"
+#include "difficulty.h"
+using namespace std;
+
+//stats slots for forked workers, plus one shared overflow slot at the end
+const int MAX_WORKERS = 64;
+
+//pid stored in a slot reserved by the parent before fork() returns
+const pid_t PID_RESERVED = -1;
+
+//counters for one worker, padded to a cache line so workers never share one
+struct alignas(64) WorkerStats {
+    atomic<int32_t>  pid;           //owner, 0 if the slot is free
+    atomic<int32_t>  busy;          //1 while serving a connection
+    atomic<int32_t>  retire;        //set by the parent: exit when idle
+    atomic<int32_t>  bank_pin;      //bank slot its current game pinned, -1 if none
+    atomic<uint64_t> connections;
+    atomic<uint64_t> commands;
+    atomic<uint64_t> games;
+    atomic<uint64_t> guesses;
+    atomic<uint64_t> errors;
+    atomic<uint64_t> allocations;   //heap allocations while serving commands
+};
+static_assert(sizeof(WorkerStats) == 64, "WorkerStats must fill exactly one cache line");
+
+//plain copy of the counters summed over all workers
+struct StatsTotals {
+    uint64_t connections;
+    uint64_t commands;
+    uint64_t games;
+    uint64_t guesses;
+    uint64_t errors;
+    uint64_t allocations;
+    uint64_t rejected_connections;
+    uint64_t rejected_commands;
+    uint64_t untracked;             //allowed because the rate table was full there
+    int      live_workers;
+    int      busy_workers;
+    uint32_t generation;
+};
+
+//one packed copy of the word bank: each length is n fixed-width records,
+//followed by an alias table per length and tier if the bank has scores
+struct BankSlot {
+    uint32_t count[MAX_WORD_LEN + 1];
+    uint64_t offset[MAX_WORD_LEN + 1];  //from the start of letters
+    uint32_t tier_count[MAX_WORD_LEN + 1][NUM_TIERS];   //0 without scores
+    uint64_t tier_offset[MAX_WORD_LEN + 1][NUM_TIERS];  //entries from the first table
+    uint64_t alias_offset;              //first alias table, from the start of letters
+    char     letters[1];                //really slot_capacity bytes
+};
+
+//layout of the shared segment; the bank slots follow, page aligned
+struct SharedSegment {
+    atomic<uint32_t> active;            //bank slot games start from
+    atomic<uint32_t> generation;        //bumped on every reload
+    atomic<uint32_t> readers[2];        //games still running on each slot
+    atomic<uint64_t> next_session;      //connections accepted so far, by all workers
+    size_t           total_size;
+    size_t           bank_offset;       //first bank slot, page aligned
+    size_t           slot_size;         //bytes per bank slot, page aligned
+    WorkerStats      workers[MAX_WORKERS + 1];
+    RateTable        limits;            //per-address token buckets, all workers
+};
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  create_shared_segment                               */
+/* Description:    Maps an anonymous POSIX shared memory segment,      */
+/*                 publishes the word bank into it and clears the      */
+/*                 stats. Rate limits start at the defaults. Children  */
+/*                 made with fork() inherit it.                        */
+/* Parameters:     const WordBank &bank: words to publish – input      */
+/* Return Value:   SharedSegment* – the mapped segment, or nullptr on  */
+/*                 error                                               */
+/*                                                                     */
+/***********************************************************************/
+
+SharedSegment *create_shared_segment(const WordBank &bank);
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  publish_word_bank                                   */
+/* Description:    Parent only. Packs a new word bank into the slot    */
+/*                 not in use and makes it the one new games start     */
+/*                 from. Running games keep their old slot.            */
+/* Parameters:     SharedSegment *shm: segment – input/output          */
+/*                 const WordBank &bank: words to publish – input      */
+/* Return Value:   bool – false if the bank does not fit or games are  */
+/*                 still running on the spare slot                     */
+/*                                                                     */
+/***********************************************************************/
+
+bool publish_word_bank(SharedSegment *shm, const WordBank &bank);
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  protect_word_bank                                   */
+/* Description:    Child only. Maps the bank slots read-only in this   */
+/*                 process.                                            */
+/* Parameters:     SharedSegment *shm: segment – input                 */
+/* Return Value:   void – no return value                              */
+/*                                                                     */
+/***********************************************************************/
+
+void protect_word_bank(SharedSegment *shm);
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  acquire_bank / release_bank                         */
+/* Description:    Pin the active bank slot for the length of a game   */
+/*                 so a reload cannot overwrite it, and unpin it. The  */
+/*                 pin is recorded in the worker's stats so the parent */
+/*                 can drop it if the worker dies mid-game.            */
+/* Parameters:     SharedSegment *shm: segment – input/output          */
+/*                 WorkerStats *owner: pinning worker – input/output   */
+/*                 int slot: slot from acquire_bank – input            */
+/* Return Value:   int – the pinned slot (acquire_bank)                */
+/*                                                                     */
+/***********************************************************************/
+
+int  acquire_bank(SharedSegment *shm, WorkerStats *owner);
+void release_bank(SharedSegment *shm, WorkerStats *owner, int slot);
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  peek_bank                                           */
+/* Description:    The slot acquire_bank would pin now, without        */
+/*                 pinning it, to check a request before giving up the */
+/*                 bank a running game holds. Counts read from it may  */
+/*                 be stale by the time the slot is pinned; look again */
+/*                 once it is.                                         */
+/* Parameters:     const SharedSegment *shm: segment – input           */
+/* Return Value:   int – the active slot                               */
+/*                                                                     */
+/***********************************************************************/
+
+int peek_bank(const SharedSegment *shm);
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  bank_words                                          */
+/* Description:    Finds the packed words of one length in a slot.     */
+/* Parameters:     const SharedSegment *shm: segment – input           */
+/*                 int slot: pinned slot – input                       */
+/*                 size_t len: word length – input                     */
+/*                 size_t &count: number of words – output             */
+/* Return Value:   const char* – count records of len letters each,    */
+/*                 not terminated                                      */
+/*                                                                     */
+/***********************************************************************/
+
+const char *bank_words(const SharedSegment *shm, int slot, size_t len, size_t &count);
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  bank_tier                                           */
+/* Description:    Finds the alias table for one difficulty tier of    */
+/*                 one length in a slot.                               */
+/* Parameters:     const SharedSegment *shm: segment – input           */
+/*                 int slot: pinned slot – input                       */
+/*                 size_t len: word length – input                     */
+/*                 int tier: TIER_* – input                            */
+/*                 size_t &count: entries in the table, 0 if the bank  */
+/*                 was published without difficulty scores – output    */
+/* Return Value:   const AliasEntry* – the table, for sample_alias     */
+/*                                                                     */
+/***********************************************************************/
+
+const AliasEntry *bank_tier(const SharedSegment *shm, int slot, size_t len, int tier,
+                            size_t &count);
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  claim_worker_stats / release_worker_stats           */
+/* Description:    Give a worker its own stats slot, or the shared     */
+/*                 overflow slot if all are taken, and free it again.  */
+/*                 Counters are kept when a slot is reused. The parent */
+/*                 may claim with PID_RESERVED before fork() and store */
+/*                 the child's pid after. Releasing also drops a bank  */
+/*                 pin the worker left behind.                         */
+/* Parameters:     SharedSegment *shm: segment – input/output          */
+/*                 pid_t pid: worker process id – input                */
+/* Return Value:   WorkerStats* – the worker's counters (claim)        */
+/*                                                                     */
+/***********************************************************************/
+
+WorkerStats *claim_worker_stats(SharedSegment *shm, pid_t pid);
+void release_worker_stats(SharedSegment *shm, pid_t pid);
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  sum_stats                                           */
+/* Description:    Adds up every worker's counters.                    */
+/* Parameters:     const SharedSegment *shm: segment – input           */
+/*                 StatsTotals &out: totals – output                   */
+/* Return Value:   void – no return value                              */
+/*                                                                     */
+/***********************************************************************/
+
+void sum_stats(const SharedSegment *shm, StatsTotals &out);
+
+#endif
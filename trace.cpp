@@ -0,0 +1,187 @@
+/************************************************************/
+/* Filename: trace.cpp */
+/* Purpose: binary capture of client commands for the server and the replay tool. */
+/************************************************************/
+
+#include "trace.h"
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Most bytes one varint can take
+const size_t MAX_VARINT = 10;
+
+// Microseconds on the monotonic clock
+uint64_t trace_clock_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+// Starts the file over with the header; session ids restart at 0 every
+// run, so an earlier capture left in the file would be mixed into this one
+int open_trace(const string &path) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (fd == -1) {
+        return -1;
+    }
+    if (write(fd, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != (ssize_t)sizeof(TRACE_MAGIC)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// 7 bits per byte, high bit set on all but the last
+static size_t put_varint(char *out, uint64_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        out[n++] = (char)(v | 0x80);
+        v >>= 7;
+    }
+    out[n++] = (char)v;
+    return n;
+}
+
+// Decodes one varint, false if the input runs out first
+static bool get_varint(const string &in, size_t &pos, uint64_t &v) {
+    v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (pos >= in.size()) {
+            return false;
+        }
+        uint8_t b = (uint8_t)in[pos++];
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if ((b & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// One write() per chunk; O_APPEND keeps each chunk in one piece
+static void trace_flush(TraceWriter &tw) {
+    if (tw.used > 0) {
+        if (write(tw.fd, tw.buf, tw.used) != (ssize_t)tw.used) {
+            tw.fd = -1;     //disk trouble: stop capturing this session
+        }
+        tw.used = 0;
+    }
+}
+
+// Appends one record, making room first if needed
+static void trace_record(TraceWriter &tw, uint8_t op, uint64_t now_us, string_view line) {
+    if (tw.fd == -1) {
+        return;
+    }
+    if (line.size() > TRACE_BUFF_SIZE - 1 - 3 * MAX_VARINT) {
+        line = line.substr(0, TRACE_BUFF_SIZE - 1 - 3 * MAX_VARINT);
+    }
+    if (TRACE_BUFF_SIZE - tw.used < 1 + 3 * MAX_VARINT + line.size()) {
+        trace_flush(tw);
+    }
+
+    char *p = tw.buf + tw.used;
+    size_t n = 0;
+    p[n++] = (char)op;
+    n += put_varint(p + n, tw.session);
+    n += put_varint(p + n, now_us - tw.last_us);
+    if (op == OP_COMMAND) {
+        n += put_varint(p + n, line.size());
+        memcpy(p + n, line.data(), line.size());
+        n += line.size();
+    }
+    tw.used   += n;
+    tw.last_us = now_us;
+}
+
+void trace_begin(TraceWriter &tw, int fd, uint64_t session, uint64_t start_us) {
+    tw.fd      = fd;
+    tw.session = session;
+    tw.last_us = start_us;      //so CONNECT's delta is from the capture start
+    tw.used    = 0;
+    trace_record(tw, OP_CONNECT, trace_clock_us(), string_view());
+}
+
+void trace_command(TraceWriter &tw, string_view line) {
+    trace_record(tw, OP_COMMAND, trace_clock_us(), line);
+}
+
+void trace_end(TraceWriter &tw) {
+    if (tw.fd == -1) {
+        return;
+    }
+    trace_record(tw, OP_CLOSE, trace_clock_us(), string_view());
+    trace_flush(tw);
+}
+
+void trace_sync(TraceWriter &tw) {
+    if (tw.fd != -1) {
+        trace_flush(tw);
+    }
+}
+
+// Rebuilds every session's events with times from the capture start
+bool load_trace(const string &path, vector<TraceSession> &out) {
+    out.clear();
+
+    ifstream fin(path.c_str(), ios::binary);
+    if (!fin.is_open()) {
+        return false;
+    }
+    string data((istreambuf_iterator<char>(fin)), istreambuf_iterator<char>());
+    if (data.size() < sizeof(TRACE_MAGIC) ||
+        memcmp(data.data(), TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0) {
+        return false;
+    }
+
+    map<uint64_t, size_t> index;        //session id -> position in out
+    size_t pos = sizeof(TRACE_MAGIC);
+    while (pos < data.size()) {
+        uint8_t op = (uint8_t)data[pos++];
+        uint64_t session, delta;
+        if (!get_varint(data, pos, session) || !get_varint(data, pos, delta)) {
+            return false;
+        }
+
+        TraceEvent ev;
+        ev.op = op;
+        if (op == OP_COMMAND) {
+            uint64_t len;
+            if (!get_varint(data, pos, len) || len > data.size() - pos) {
+                return false;
+            }
+            ev.line.assign(data, pos, (size_t)len);
+            pos += (size_t)len;
+        } else if (op != OP_CONNECT && op != OP_CLOSE) {
+            return false;
+        }
+
+        map<uint64_t, size_t>::iterator it = index.find(session);
+        if (it == index.end()) {
+            if (op != OP_CONNECT) {
+                continue;   //its CONNECT was not captured, skip the session
+            }
+            TraceSession ts;
+            ts.id = session;
+            out.push_back(ts);
+            it = index.insert(make_pair(session, out.size() - 1)).first;
+        }
+
+        vector<TraceEvent> &events = out[it->second].events;
+        ev.at_us = (events.empty() ? 0 : events.back().at_us) + delta;
+        events.push_back(ev);
+    }
+
+    sort(out.begin(), out.end(), [](const TraceSession &a, const TraceSession &b) {
+        return a.events[0].at_us < b.events[0].at_us;
+    });
+    return true;
+}
@@ -0,0 +1,120 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+using namespace std;
+
+//trace file layout: TRACE_MAGIC, then records of
+//  [op:1][session:varint][delta_us:varint]            CONNECT, CLOSE
+//  [op:1][session:varint][delta_us:varint][len:varint][len bytes]   COMMAND
+//CONNECT's delta is from the start of the capture, the others' from the
+//session's previous record. Records of different sessions may interleave.
+const char TRACE_MAGIC[8] = {'W', 'R', 'D', 'L', 'T', 'R', 'C', '1'};
+
+const uint8_t OP_CONNECT = 1;
+const uint8_t OP_COMMAND = 2;
+const uint8_t OP_CLOSE   = 3;
+
+//records are buffered per session and written in whole chunks
+const size_t TRACE_BUFF_SIZE = 4096;
+
+//capture state for one connection; fd -1 means capture is off
+struct TraceWriter {
+    int      fd;
+    uint64_t session;
+    uint64_t last_us;
+    size_t   used;
+    char     buf[TRACE_BUFF_SIZE];
+};
+
+//one recorded event, time measured from the start of the capture
+struct TraceEvent {
+    uint8_t  op;
+    uint64_t at_us;
+    string   line;      //COMMAND only
+};
+
+//every event of one connection, in order
+struct TraceSession {
+    uint64_t id;
+    vector<TraceEvent> events;
+};
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  trace_clock_us                                      */
+/* Description:    Monotonic clock in microseconds, the same in every  */
+/*                 process on the host.                                */
+/* Parameters:     none                                                */
+/* Return Value:   uint64_t – microseconds since an arbitrary point    */
+/*                                                                     */
+/***********************************************************************/
+
+uint64_t trace_clock_us();
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  open_trace                                          */
+/* Description:    Opens a trace file for appending, emptying it first */
+/*                 and writing the magic header.                       */
+/* Parameters:     const string &path: trace file – input              */
+/* Return Value:   int – file descriptor, or -1 on error               */
+/*                                                                     */
+/***********************************************************************/
+
+int open_trace(const string &path);
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  trace_begin / trace_command / trace_end             */
+/* Description:    Record a connection opening, one command line from  */
+/*                 the client, and the connection closing. trace_end   */
+/*                 also writes out anything still buffered. All do     */
+/*                 nothing if fd is -1.                                */
+/* Parameters:     TraceWriter &tw: this connection's writer – output  */
+/*                 int fd: from open_trace, or -1 – input              */
+/*                 uint64_t session: connection id – input             */
+/*                 uint64_t start_us: trace_clock_us() when capture    */
+/*                 started – input                                     */
+/*                 string_view line: the command as received – input   */
+/* Return Value:   void – no return value                              */
+/*                                                                     */
+/***********************************************************************/
+
+void trace_begin(TraceWriter &tw, int fd, uint64_t session, uint64_t start_us);
+void trace_command(TraceWriter &tw, string_view line);
+void trace_end(TraceWriter &tw);
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  trace_sync                                          */
+/* Description:    Writes out the records buffered so far, so a        */
+/*                 process killed after this loses none of them. Does  */
+/*                 nothing if none are buffered or fd is -1.           */
+/* Parameters:     TraceWriter &tw: this connection's writer – input/  */
+/*                 output                                              */
+/* Return Value:   void – no return value                              */
+/*                                                                     */
+/***********************************************************************/
+
+void trace_sync(TraceWriter &tw);
+
+/***********************************************************************/
+/*                                                                     */
+/* Function name:  load_trace                                          */
+/* Description:    Reads a whole trace file and groups its events by   */
+/*                 session, sessions ordered by connect time.          */
+/* Parameters:     const string &path: trace file – input              */
+/*                 vector<TraceSession> &out: sessions – output        */
+/* Return Value:   bool – false if the file can't be read, has no      */
+/*                 magic header, or ends partway through a record      */
+/*                                                                     */
+/***********************************************************************/
+
+bool load_trace(const string &path, vector<TraceSession> &out);
+
+#endif